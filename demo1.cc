@@ -3,6 +3,7 @@
 #include <vector>
 #include <cmath>
 #include <valarray>
+#include <utility>
 #include "pgplot.hh"
 
 // ISSUES:
@@ -83,14 +84,11 @@ void example2(const pgplot::device& dev)
   dev.env(-2, 10, -.4, 1.2, false, pgplot::axis::axis);
   dev.label("(x)", "sin(x)/x", "PGPLOT Example 2:  Sinc Function");
 
-  const int npoints = 100;
-  std::valarray<double> xr(npoints);
-  std::vector<float> yr(npoints);
-  for (int i=0; i<npoints; i++) {
-    xr[i] = ((i+1)-20) / 6.0;
-    yr[i] = xr[i] != 0.0 ? sin(xr[i])/xr[i] : 1.0;
-  }
-  dev.draw_lines(xr, yr);
+  // evaluated lazily, no arrays needed
+  dev.draw_lines(pgplot::generate(100, [](size_t i) {
+	double x = (int(i+1)-20) / 6.0;
+	return std::make_pair(x, x != 0.0 ? sin(x)/x : 1.0);
+      }));
 }
 
 void example3(const pgplot::device& dev)
@@ -195,23 +193,17 @@ void example5(const pgplot::device& dev)
   dev.set_color_index(red);
   dev.draw_lines(100, xp, yp);
 
-  for (int i=0; i<n; i++)
-    {
-      xp[i] = log10(freq[i]) - 3;
-      yp[i] = log10(flux[i]);
-    }
+  // log10 of the data is taken while it is converted, frequencies in GHz
+  dev.set_data_transform(pgplot::transform(3), pgplot::transform());
   dev.set_color_index(green);
-  dev.draw_points(n, xp, yp, 17);
+  dev.draw_points(n, freq, flux, 17, pgplot::axis::log);
 
-  std::vector<float> yhigh(n);
-  std::vector<float> ylow(yhigh);
+  std::vector<float> err2(n);
   for (int i=0; i<n; i++)
-    {
-      yhigh[i] = log10(flux[i] + 2 * err[i]);
-      ylow[i] = log10(flux[i] - 2 * err[i]);
-    }
+    err2[i] = 2 * err[i];
 
-  dev.errbary(n, xp, &ylow[0], &yhigh[0], 1);
+  dev.errbar(pgplot::err::y, n, freq, flux, &err2[0], 1, pgplot::axis::log);
+  dev.set_data_transform(pgplot::transform(), pgplot::transform());
   pgplot::unsave();
 }
 
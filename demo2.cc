@@ -173,6 +173,28 @@ void example4(const pgplot::device& dev)
 
 void example5(const pgplot::device& dev)
 {
+  pgplot::begin_batch();
+
+  dev.env(0, 10, 0, 12, false, pgplot::axis::box);
+  dev.label("x", "y", "\\fiPGPLOT \\frError Bars");
+
+  const int n = 40;
+  std::vector<double> x(n), y(n), below(n), above(n);
+  for (int i=0; i<n; ++i) {
+    x[i] = 0.25 * (i + 0.5);
+    y[i] = 6 + 4 * sin(0.6 * x[i]);
+    below[i] = 0.3 + 0.05 * i;
+    above[i] = 0.5 * below[i];
+  }
+
+  dev.set_color_index(2);
+  dev.errbars_asymmetric(pgplot::err::y, x, y, below, above, 1);
+  dev.set_color_index(3);
+  dev.errbars(pgplot::err::x, x, y, std::vector<float>(n, 0.1f), 1);
+  dev.set_color_index(1);
+  dev.draw_points(x, y, 17);
+
+  pgplot::end_batch();
 }
 
 void example6(const pgplot::device&)
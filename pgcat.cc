@@ -0,0 +1,413 @@
+// pgcat: quick-look plots of numeric columns read from files or stdin
+//
+//   pgcat [-d device] [-x col] [-y col] [-s symbol] [-L x|y|xy]
+//         [-w xmin,xmax,ymin,ymax] [-X xlabel] [-Y ylabel] [-T title]
+//         [file ...]
+//
+// Columns are separated by blanks, commas or semicolons and numbered
+// from 1; column 0 is the line number.  Lines that start with '#' or
+// lack the columns are skipped.  Each file is drawn in its own colour.
+//
+// With -w the window is fixed up front and points are drawn as they
+// arrive, so a pipe can be watched while it is still being written.
+// Otherwise each input is read twice, once for the data limits and once
+// to draw it, and only input that cannot be read again (stdin from a
+// pipe or terminal) is kept in memory between the two.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pgplot.hh"
+
+namespace {
+
+  // locale-independent decimal parser; returns the end of the number at
+  // p, or 0 if there is none
+  const char* parse_double(const char* p, const char* end, double& v)
+  {
+    static const double pow10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+      neg = *p++ == '-';
+
+    if (end - p >= 3 && (std::strncmp(p, "nan", 3) == 0 || std::strncmp(p, "NaN", 3) == 0)) {
+      v = std::numeric_limits<double>::quiet_NaN();
+      return p + 3;
+    }
+    if (end - p >= 3 && (std::strncmp(p, "inf", 3) == 0 || std::strncmp(p, "Inf", 3) == 0)) {
+      v = neg ? -HUGE_VAL : HUGE_VAL;
+      return p + 3;
+    }
+
+    // up to 19 significant digits are kept exactly, the rest only
+    // contribute to the exponent
+    std::uint64_t mant = 0;
+    int digits = 0, exp10 = 0;
+    const char* start = p;
+    for (; p < end && unsigned(*p - '0') < 10; ++p)
+      if (digits < 19) {
+	mant = mant * 10 + (*p - '0');
+	digits += mant != 0;
+      }
+      else
+	++exp10;
+    if (p < end && *p == '.')
+      for (++p; p < end && unsigned(*p - '0') < 10; ++p)
+	if (digits < 19) {
+	  mant = mant * 10 + (*p - '0');
+	  digits += mant != 0;
+	  --exp10;
+	}
+    if (p == start || (p == start+1 && *start == '.'))
+      return 0;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      const char* q = p + 1;
+      bool eneg = false;
+      if (q < end && (*q == '-' || *q == '+'))
+	eneg = *q++ == '-';
+      if (q < end && unsigned(*q - '0') < 10) {
+	int e = 0;
+	for (; q < end && unsigned(*q - '0') < 10; ++q)
+	  if (e < 100000)
+	    e = e * 10 + (*q - '0');
+	exp10 += eneg ? -e : e;
+	p = q;
+      }
+    }
+
+    double d = double(mant);
+    if (exp10 >= 0 && exp10 <= 22)
+      d *= pow10[exp10];
+    else if (exp10 < 0 && exp10 >= -22)
+      d /= pow10[-exp10];
+    else
+      d *= std::pow(10.0, exp10);
+    v = neg ? -d : d;
+    return p;
+  }
+
+  inline bool separator(char c)
+  {
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+  }
+
+  struct options {
+    std::string device;
+    int xcol, ycol;
+    int symbol;			// 0 for lines
+    pgplot::axis::value log;
+    bool window;
+    double x1, x2, y1, y2;
+    std::string xlabel, ylabel, title;
+    options() : device(std::getenv("PGPLOT_DEV") ? std::getenv("PGPLOT_DEV") : "?"),
+		xcol(1), ycol(2), symbol(0), log(pgplot::axis::label), window(false),
+		x1(0), x2(1), y1(0), y2(1) { }
+  };
+
+  // collects points from input lines and passes them on to the device
+  // in chunks.  Without a fixed window a scanning pass comes first that
+  // only finds the data limits, keeping the points of inputs that cannot
+  // be read twice.
+  class plotter {
+  public:
+    plotter(const pgplot::device& dev, const options& opt)
+      : dev_(dev), opt_(opt), line_(0), drawn_(0), series_(0), scanning_(false), keep_(false),
+	x1_(std::numeric_limits<double>::max()), x2_(-x1_), y1_(x1_), y2_(-x1_) { }
+
+    // start an input in the scanning pass; keep its points if it cannot
+    // be read again
+    void scan_series(bool keep)
+    {
+      scanning_ = true;
+      keep_ = keep;
+      line_ = 0;
+      kept_.push_back(keep ? all_x_.size() : npos);
+    }
+
+    // end the scanning pass: set the window from the data limits
+    void set_window()
+    {
+      scanning_ = false;
+      kept_.push_back(all_x_.size());
+      finish_limits(x1_, x2_);
+      finish_limits(y1_, y2_);
+      dev_.env(x1_, x2_, y1_, y2_, false, opt_.log);
+      dev_.label(opt_.xlabel, opt_.ylabel, opt_.title);
+    }
+
+    // start drawing an input, in its own colour
+    void start_series()
+    {
+      flush();
+      xs_.clear();
+      ys_.clear();
+      line_ = 0;
+      drawn_ = 0;
+      ++series_;
+      dev_.set_color_index(series_);
+    }
+
+    // draw the kept points of scanned input k, if it was kept
+    bool draw_kept(size_t k)
+    {
+      if (kept_[k] == npos)
+	return false;
+      size_t end = all_x_.size();
+      for (size_t j=k+1; j<kept_.size(); ++j)
+	if (kept_[j] != npos) {
+	  end = kept_[j];
+	  break;
+	}
+      if (end > kept_[k])
+	draw(end - kept_[k], &all_x_[kept_[k]], &all_y_[kept_[k]]);
+      return true;
+    }
+
+    // parse the line [p, end)
+    void line(const char* p, const char* end)
+    {
+      ++line_;
+      const int want = std::max(opt_.xcol, opt_.ycol);
+      double x = line_, y = line_;
+      for (int col=1; col<=want; ++col) {
+	while (p < end && separator(*p))
+	  ++p;
+	if (p == end || *p == '#')
+	  return;
+	double v;
+	const char* q = parse_double(p, end, v);
+	if (!q || (q < end && !separator(*q)))
+	  return;
+	if (col == opt_.xcol)
+	  x = v;
+	if (col == opt_.ycol)
+	  y = v;
+	p = q;
+      }
+      if (scanning_) {
+	extend(x, opt_.log == pgplot::axis::xlog || opt_.log == pgplot::axis::log, x1_, x2_);
+	extend(y, opt_.log == pgplot::axis::ylog || opt_.log == pgplot::axis::log, y1_, y2_);
+	if (keep_) {
+	  all_x_.push_back(x);
+	  all_y_.push_back(y);
+	}
+	return;
+      }
+      xs_.push_back(x);
+      ys_.push_back(y);
+      if (xs_.size() >= pgplot::chunk_size)
+	flush();
+    }
+
+    // draw what arrived since the last flush; a polyline restarts from
+    // the last point drawn
+    void flush()
+    {
+      if (scanning_ || xs_.size() <= (drawn_ && !opt_.symbol ? 1u : 0u))
+	return;
+      draw(xs_.size(), &xs_[0], &ys_[0]);
+      if (opt_.window)
+	dev_.update();
+      drawn_ += xs_.size();
+      const size_t keep = opt_.symbol ? 0 : 1;
+      xs_.erase(xs_.begin(), xs_.end() - keep);
+      ys_.erase(ys_.begin(), ys_.end() - keep);
+    }
+
+    void finish() { flush(); }
+
+  private:
+    static const size_t npos = size_t(-1);
+
+    const pgplot::device& dev_;
+    const options& opt_;
+    size_t line_, drawn_;
+    int series_;
+    bool scanning_, keep_;
+    double x1_, x2_, y1_, y2_;			// data limits
+    std::vector<double> xs_, ys_;		// pending
+    std::vector<double> all_x_, all_y_;		// kept while scanning
+    std::vector<size_t> kept_;			// start in all_x_ per input, or npos
+
+    void draw(size_t n, const double* x, const double* y) const
+    {
+      if (opt_.symbol)
+	dev_.draw_points(n, x, y, opt_.symbol, opt_.log);
+      else
+	dev_.draw_lines(n, x, y, opt_.log);
+    }
+
+    // widen lo..hi to v, in decades for log axes
+    static void extend(double v, bool log, double& lo, double& hi)
+    {
+      if (!std::isfinite(v) || (log && v <= 0))
+	return;
+      const double w = log ? std::log10(v) : v;
+      lo = std::min(lo, w);
+      hi = std::max(hi, w);
+    }
+
+    // world limits with a 5% margin
+    static void finish_limits(double& lo, double& hi)
+    {
+      if (lo > hi)
+	lo = 0, hi = 1;
+      const double margin = hi > lo ? 0.05 * (hi - lo) : 0.5;
+      lo -= margin;
+      hi += margin;
+    }
+  };
+
+  // read fd to the end, handing complete lines to p; memchr finds the
+  // line ends a vector at a time
+  void read_lines(int fd, plotter& p)
+  {
+    std::vector<char> buf(1 << 20);
+    size_t have = 0;
+    for (;;) {
+      const ssize_t r = read(fd, &buf[have], buf.size() - have);
+      if (r < 0)
+	throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+      if (r == 0)
+	break;
+      have += r;
+      const char* s = &buf[0];
+      const char* end = s + have;
+      while (const char* nl = static_cast<const char*>(std::memchr(s, '\n', end - s))) {
+	p.line(s, nl);
+	s = nl + 1;
+      }
+      if (s == &buf[0] && have == buf.size()) {
+	// longer than the buffer: take it as a line
+	p.line(s, end);
+	s = end;
+      }
+      have = end - s;
+      std::memmove(&buf[0], s, have);
+      p.flush();
+    }
+    if (have)
+      p.line(&buf[0], &buf[0] + have);
+  }
+
+  // fd for file, 0 for "-"
+  int open_input(const std::string& file)
+  {
+    const int fd = file == "-" ? 0 : open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("cannot open " + file);
+    return fd;
+  }
+
+  void usage()
+  {
+    std::cerr << "usage: pgcat [-d device] [-x col] [-y col] [-s symbol] [-L x|y|xy]\n"
+	      << "             [-w xmin,xmax,ymin,ymax] [-X xlabel] [-Y ylabel] [-T title]\n"
+	      << "             [file ...]" << std::endl;
+    std::exit(2);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  options opt;
+  int c;
+  while ((c = getopt(argc, argv, "d:x:y:s:L:w:X:Y:T:")) != -1) {
+    switch (c) {
+    case 'd': opt.device = optarg; break;
+    case 'x': opt.xcol = std::atoi(optarg); break;
+    case 'y': opt.ycol = std::atoi(optarg); break;
+    case 's': opt.symbol = std::atoi(optarg); break;
+    case 'L':
+      opt.log = std::string(optarg) == "x" ? pgplot::axis::xlog
+	: std::string(optarg) == "y" ? pgplot::axis::ylog : pgplot::axis::log;
+      break;
+    case 'w':
+      if (std::sscanf(optarg, "%lf,%lf,%lf,%lf", &opt.x1, &opt.x2, &opt.y1, &opt.y2) != 4)
+	usage();
+      opt.window = true;
+      break;
+    case 'X': opt.xlabel = optarg; break;
+    case 'Y': opt.ylabel = optarg; break;
+    case 'T': opt.title = optarg; break;
+    default: usage();
+    }
+  }
+  if (opt.xcol < 0 || opt.ycol < 0)
+    usage();
+
+  try {
+    pgplot::debug = false;
+    pgplot::device dev(opt.device);
+    plotter p(dev, opt);
+
+    if (opt.window) {
+      // limits are given in data units; take logs for log axes
+      const bool xl = opt.log == pgplot::axis::xlog || opt.log == pgplot::axis::log;
+      const bool yl = opt.log == pgplot::axis::ylog || opt.log == pgplot::axis::log;
+      dev.env(xl ? std::log10(opt.x1) : opt.x1, xl ? std::log10(opt.x2) : opt.x2,
+	      yl ? std::log10(opt.y1) : opt.y1, yl ? std::log10(opt.y2) : opt.y2,
+	      false, opt.log);
+      dev.label(opt.xlabel, opt.ylabel, opt.title);
+    }
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+    if (files.empty())
+      files.push_back("-");
+
+    if (opt.window)
+      for (size_t i=0; i<files.size(); ++i) {
+	const int fd = open_input(files[i]);
+	p.start_series();
+	read_lines(fd, p);
+	if (fd)
+	  close(fd);
+      }
+    else {
+      // stdin is read again from where it started if it is a file
+      const off_t stdin_start = lseek(0, 0, SEEK_CUR);
+      for (size_t i=0; i<files.size(); ++i) {
+	const int fd = open_input(files[i]);
+	struct stat st;
+	p.scan_series(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (!fd && stdin_start < 0));
+	read_lines(fd, p);
+	if (fd)
+	  close(fd);
+      }
+      p.set_window();
+      for (size_t i=0; i<files.size(); ++i) {
+	p.start_series();
+	if (p.draw_kept(i))
+	  continue;
+	const int fd = open_input(files[i]);
+	if (!fd && lseek(0, stdin_start, SEEK_SET) < 0)
+	  throw std::runtime_error("cannot rewind stdin");
+	read_lines(fd, p);
+	if (fd)
+	  close(fd);
+      }
+    }
+    p.finish();
+  }
+  catch (const std::exception& e) {
+    std::cerr << "Exception caught, terminating: " << e.what() << std::endl;
+    return 1;
+  }
+}
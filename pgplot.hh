@@ -9,6 +9,15 @@
 #include <vector>
 #include <valarray>
 #include <algorithm>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <cmath>
+#include <limits>
 
 extern "C" {
 #include <cpgplot.h>
@@ -25,59 +34,254 @@ namespace pgplot {
 
   bool debug = true;
 
+  // the most points passed to PGPLOT in one call by the streaming array
+  // drawing calls, which also bounds their conversion buffer
+  size_t chunk_size = 65536;
+
+  // map applied to input data while it is narrowed to float,
+  // world = (value - offset) * scale, optionally preceded by log10, and
+  // evaluated in double precision so that e.g. MJD or UNIX times keep
+  // their sub-second resolution
+  class transform {
+  public:
+    double offset;
+    double scale;
+    bool log;
+
+    transform(double offset_=0, double scale_=1, bool log_=false)
+      : offset(offset_), scale(scale_), log(log_) { }
+
+    // log10 for use with axis::xlog/ylog/log plots
+    static transform log10(double offset=0, double scale=1)
+    { return transform(offset, scale, true); }
+
+    // written as log()*log10(e) so that vectorizing compilers can use
+    // their SIMD log; NaN for non-positive data, which draw_lines leaves
+    // as a gap and other calls skip
+    static double log10_(double v) throw()
+    {
+      return v > 0 ? std::log(v) * 0.434294481903251827651
+	: std::numeric_limits<double>::quiet_NaN();
+    }
+
+    bool identity() const throw() { return offset == 0 && scale == 1 && !log; }
+
+    float operator()(double v) const throw()
+    { return ((log ? log10_(v) : v) - offset) * scale; }
+
+    double inverse(double w) const throw()
+    {
+      double v = w / scale + offset;
+      return log ? std::pow(10.0, v) : v;
+    }
+
+    // axis label for the transformed coordinate, e.g. "MJD - 59000";
+    // with log set the offset and scale are in decades and the log
+    // itself is left to the axis labelling
+    std::string label(const std::string& name) const
+    {
+      if ((offset == 0 && scale == 1) || name.empty())
+	return name;
+      std::ostringstream os;
+      os.precision(15);
+      if (offset != 0)
+	os << (scale != 1 ? "(" : "") << name
+	   << (offset < 0 ? " + " : " - ") << std::abs(offset)
+	   << (scale != 1 ? ")" : "");
+      else
+	os << name;
+      if (scale != 1)
+	os << " \\x " << scale;
+      return os.str();
+    }
+  };
+
+  namespace detail {
+
+    // the conversion kernel: narrow n values to float applying xf
+    template <typename It>
+    void narrow(It first, size_t n, float* out, const transform& xf)
+    {
+      if (xf.identity())
+	for (size_t i=0; i<n; ++i, ++first)
+	  out[i] = *first;
+      else if (xf.log)
+	for (size_t i=0; i<n; ++i, ++first)
+	  out[i] = (transform::log10_(*first) - xf.offset) * xf.scale;
+      else
+	for (size_t i=0; i<n; ++i, ++first)
+	  out[i] = (*first - xf.offset) * xf.scale;
+    }
+
+    // n converted values from pos on, in buf unless the data is float
+    // that needs no conversion.  Besides arrays, any source class with
+    //   size_t size() const;
+    //   const float* direct(const transform&) const;  // or 0
+    //   void read(size_t pos, size_t n, float* out, const transform&) const;
+    // can be used, see e.g. pgplot::column.
+    template <typename T>
+    const float* slice(const T* p, size_t pos, size_t n, float* buf, const transform& xf)
+    {
+      narrow(p+pos, n, buf, xf);
+      return buf;
+    }
+
+    inline const float* slice(const float* p, size_t pos, size_t n, float* buf, const transform& xf)
+    {
+      if (xf.identity())
+	return p+pos;
+      narrow(p+pos, n, buf, xf);
+      return buf;
+    }
+
+    template <typename S>
+    const float* slice(const S& src, size_t pos, size_t n, float* buf, const transform& xf)
+    {
+      if (const float* p = src.direct(xf))
+	return p+pos;
+      src.read(pos, n, buf, xf);
+      return buf;
+    }
+
+    // what stream() reads a container argument through
+    template <typename T>
+    const T* data_of(const std::vector<T>& v) { return v.empty() ? 0 : &v[0]; }
+
+    template <typename T>
+    const T* data_of(const std::valarray<T>& v) { return v.size() ? &v[0] : 0; }
+
+    template <typename S>
+    const S& data_of(const S& src) { return src; }
+
+    // 64-bit hash of n bytes, a word at a time
+    inline std::uint64_t hash_bytes(const void* p, size_t n, std::uint64_t h = 0x9e3779b97f4a7c15ULL) throw()
+    {
+      const unsigned char* c = static_cast<const unsigned char*>(p);
+      for (; n >= 8; c += 8, n -= 8) {
+	std::uint64_t w;
+	std::memcpy(&w, c, 8);
+	h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	h ^= h >> 29;
+      }
+      for (; n; ++c, --n)
+	h = (h ^ *c) * 0x100000001b3ULL;
+      h ^= h >> 32;
+      h *= 0xd6e8feb86659fd93ULL;
+      return h ^ (h >> 32);
+    }
+
+    // one Sutherland-Hodgman step: the polygon x, y cut by the line
+    // where coordinate axis (0 for x, 1 for y) equals bound, keeping the
+    // side above it if above is set, else the side below
+    inline void clip_edge(const std::vector<float>& x, const std::vector<float>& y,
+			  std::vector<float>& ox, std::vector<float>& oy,
+			  int axis, float bound, bool above)
+    {
+      ox.clear();
+      oy.clear();
+      const size_t n = x.size();
+      for (size_t i=0, j=n-1; i<n; j=i++) {
+	const float a = axis ? y[j] : x[j], b = axis ? y[i] : x[i];
+	const bool in_a = above ? a >= bound : a <= bound;
+	const bool in_b = above ? b >= bound : b <= bound;
+	if (in_a != in_b) {
+	  const float t = (bound - a) / (b - a);
+	  ox.push_back(axis ? x[j] + t * (x[i] - x[j]) : bound);
+	  oy.push_back(axis ? bound : y[j] + t * (y[i] - y[j]));
+	}
+	if (in_b) {
+	  ox.push_back(x[i]);
+	  oy.push_back(y[i]);
+	}
+      }
+    }
+
+    // the polygon x, y (n vertices) clipped to the box x1..x2, y1..y2,
+    // left in x and y; tx, ty are scratch
+    inline void clip_polygon(size_t n, const float* px, const float* py,
+			     float x1, float x2, float y1, float y2,
+			     std::vector<float>& x, std::vector<float>& y,
+			     std::vector<float>& tx, std::vector<float>& ty)
+    {
+      x.assign(px, px+n);
+      y.assign(py, py+n);
+      clip_edge(x, y, tx, ty, 0, x1, true);
+      clip_edge(tx, ty, x, y, 0, x2, false);
+      clip_edge(x, y, tx, ty, 1, y1, true);
+      clip_edge(tx, ty, x, y, 1, y2, false);
+    }
+  }
+
   class auto_float {
 
     friend class device;
+    friend class recording;
+    friend class series_batch;
 
   private:
     bool our_data;
     size_t n;
     float *data;
 
+    // the single conversion pass: narrow and transform n values
+    template <typename It>
+    void convert(It first, const transform& xf)
+    {
+      detail::narrow(first, n, data, xf);
+    }
+
   public:
 
     template <typename T>
-    auto_float(const std::vector<T>& v)
+    auto_float(const std::vector<T>& v, const transform& xf = transform())
       : our_data(true), n(v.size()), data(new float[n])
     {
-      copy(v.begin(), v.end(), data);
+      convert(v.begin(), xf);
     }
 
     template <typename T>
-    auto_float(size_t n_, const std::vector<T>& v)
+    auto_float(size_t n_, const std::vector<T>& v, const transform& xf = transform())
       : our_data(true), n(n_), data(new float[n])
     {
-      copy(v.begin(), v.begin()+n, data);
+      convert(v.begin(), xf);
     }
 
     template <typename T>
-    auto_float(const std::valarray<T>& v)
+    auto_float(const std::valarray<T>& v, const transform& xf = transform())
       : our_data(true), n(v.size()), data(new float[n])
     {
-      for (size_t i=0; i<n; ++i)
-	data[i] = v[i];
+      convert(&v[0], xf);
     }
 
     template <typename T>
-    auto_float(size_t n_, const std::valarray<T>& v)
+    auto_float(size_t n_, const std::valarray<T>& v, const transform& xf = transform())
       : our_data(true), n(n_), data(new float[n])
     {
-      for (size_t i=0; i<n; i++)
-	data[i] = v[i];
+      convert(&v[0], xf);
     }
 
     template <typename T>
-    auto_float(size_t n_, const T* data_)
+    auto_float(size_t n_, const T* data_, const transform& xf = transform())
       : our_data(true), n(n_), data(new float[n])
     {
-      std::copy(data_, data_+n, data);
+      convert(data_, xf);
     }
 
     template <typename T>
-    auto_float(const T* begin, const T* end)
+    auto_float(const T* begin, const T* end, const transform& xf = transform())
       : our_data(true), n(end-begin), data(new float[n])
     {
-      std::copy(begin, end, data);
+      convert(begin, xf);
+    }
+
+    // any source class, see detail::slice()
+    template <typename S>
+    auto_float(const S& src, const transform& xf = transform())
+      : our_data(!src.direct(xf)), n(src.size()),
+	data(our_data ? new float[n] : const_cast<float*>(src.direct(xf)))
+    {
+      if (our_data)
+	src.read(0, n, data, xf);
     }
 
     ~auto_float() {
@@ -87,36 +291,412 @@ namespace pgplot {
   };
 
   //
-  // specializations for efficiency when passed float[], vector<float>
+  // specializations for efficiency when passed float[], vector<float>;
+  // data is only copied when a non-identity transform must be applied
   //
-  template <> auto_float::auto_float(size_t n_, const float* data_)
-    : our_data(false), n(n_), data(const_cast<float*>(data_))
+  template <> auto_float::auto_float(size_t n_, const float* data_, const transform& xf)
+    : our_data(!xf.identity()), n(n_),
+      data(our_data ? new float[n] : const_cast<float*>(data_))
   {
-    if (debug)
+    if (our_data)
+      convert(data_, xf);
+    else if (debug)
       std::cerr << "auto_float(size_t, const* float)" << std::endl;
   }
 
-  template <> auto_float::auto_float(const float* begin, const float* end)
-    : our_data(false), n(end-begin), data(const_cast<float*>(begin))
+  template <> auto_float::auto_float(const float* begin, const float* end, const transform& xf)
+    : our_data(!xf.identity()), n(end-begin),
+      data(our_data ? new float[n] : const_cast<float*>(begin))
   {
-    if (debug)
+    if (our_data)
+      convert(begin, xf);
+    else if (debug)
       std::cerr << "auto_float(const* float, const* float)" << std::endl;
   }
 
-  template <> auto_float::auto_float(const std::vector<float>& data_)
-    : our_data(false), n(data_.size()), data(const_cast<float*>(&data_[0]))
+  template <> auto_float::auto_float(const std::vector<float>& data_, const transform& xf)
+    : our_data(!xf.identity()), n(data_.size()),
+      data(our_data ? new float[n] : const_cast<float*>(&data_[0]))
   {
-    if (debug)
+    if (our_data)
+      convert(data_.begin(), xf);
+    else if (debug)
       std::cerr << "auto_float(std::vector<float>&)" << std::endl;
   }
 
-  template <> auto_float::auto_float(size_t n_, const std::vector<float>& data_)
-    : our_data(false), n(n_), data(const_cast<float*>(&data_[0]))
+  template <> auto_float::auto_float(size_t n_, const std::vector<float>& data_, const transform& xf)
+    : our_data(!xf.identity()), n(n_),
+      data(our_data ? new float[n] : const_cast<float*>(&data_[0]))
   {
-    if (debug)
+    if (our_data)
+      convert(data_.begin(), xf);
+    else if (debug)
       std::cerr << "auto_float(size_t, std::vector<float>&)" << std::endl;
   }
 
+  //
+  // lazily evaluated inputs for draw_lines and draw_points, read straight
+  // into the chunk buffer so that no full-size array is materialised
+  //
+
+  // x from [xfirst, xlast), y from yfirst onwards; input iterators are
+  // fine, each element is read once
+  template <typename It1, typename It2>
+  class iter_source {
+  private:
+    It1 xfirst, xlast;
+    It2 yfirst;
+
+  public:
+    iter_source(It1 xfirst_, It1 xlast_, It2 yfirst_)
+      : xfirst(xfirst_), xlast(xlast_), yfirst(yfirst_) { }
+
+    // convert up to k more points, returns the number read
+    size_t fill(float* x, float* y, size_t k, const transform& xf, const transform& yf)
+    {
+      size_t i;
+      for (i=0; i<k && xfirst!=xlast; ++i, ++xfirst, ++yfirst) {
+	x[i] = xf(*xfirst);
+	y[i] = yf(*yfirst);
+      }
+      return i;
+    }
+  };
+
+  template <typename It1, typename It2>
+  iter_source<It1, It2> range(It1 xfirst, It1 xlast, It2 yfirst)
+  {
+    return iter_source<It1, It2>(xfirst, xlast, yfirst);
+  }
+
+  // any pair of containers, e.g. std::list or std::deque
+  template <typename C1, typename C2>
+  iter_source<typename C1::const_iterator, typename C2::const_iterator>
+  range(const C1& x, const C2& y)
+  {
+    return range(x.begin(), x.end(), y.begin());
+  }
+
+  // n points from f(i), which returns anything with first and second
+  // members (e.g. std::pair) holding x and y
+  template <typename F>
+  class generator {
+  private:
+    size_t i, n;
+    F f;
+
+  public:
+    generator(size_t n_, F f_) : i(0), n(n_), f(f_) { }
+
+    size_t fill(float* x, float* y, size_t k, const transform& xf, const transform& yf)
+    {
+      k = std::min(k, n-i);
+      for (size_t j=0; j<k; ++j, ++i) {
+	const auto p = f(i);
+	x[j] = xf(p.first);
+	y[j] = yf(p.second);
+      }
+      return k;
+    }
+  };
+
+  template <typename F>
+  generator<F> generate(size_t n, F f)
+  {
+    return generator<F>(n, f);
+  }
+
+  // Douglas-Peucker polyline simplification with a tolerance in device
+  // pixels, plus a cache of results keyed by the converted data, the
+  // tolerance and the pixel scale so that repeated redraws are cheap
+  class simplifier {
+  public:
+    float tolerance;		// device pixels, 0 disables
+    size_t capacity;		// most points held in the cache
+
+    simplifier() : tolerance(0), capacity(1 << 20), cached(0) { }
+
+    // simplify the n points at x, y, where sx and sy are pixels per world
+    // unit; the result stays valid until the next call
+    size_t apply(size_t n, const float* x, const float* y, double sx, double sy,
+		 const float*& ox, const float*& oy)
+    {
+      const std::uint64_t key = hash(n, x, y, sx, sy);
+      std::unordered_map<std::uint64_t, lru_list::iterator>::iterator it = index.find(key);
+      if (it != index.end() && it->second->second.n == n) {
+	lru.splice(lru.begin(), lru, it->second);
+      }
+      else {
+	lru.push_front(std::make_pair(key, entry()));
+	entry& e = lru.front().second;
+	e.n = n;
+	run(n, x, y, sx, sy);
+	for (size_t i=0; i<n; ++i)
+	  if (keep[i]) {
+	    e.x.push_back(x[i]);
+	    e.y.push_back(y[i]);
+	  }
+	if (it != index.end())
+	  evict(it->second);
+	index[key] = lru.begin();
+	cached += e.x.size();
+	while (cached > capacity && lru.size() > 1)
+	  evict(--lru.end());
+      }
+      const entry& e = lru.front().second;
+      ox = e.x.empty() ? 0 : &e.x[0];
+      oy = e.y.empty() ? 0 : &e.y[0];
+      return e.x.size();
+    }
+
+    void clear()
+    {
+      lru.clear();
+      index.clear();
+      cached = 0;
+    }
+
+  private:
+    struct entry { size_t n; std::vector<float> x, y; };
+    typedef std::list< std::pair<std::uint64_t, entry> > lru_list;
+
+    lru_list lru;
+    std::unordered_map<std::uint64_t, lru_list::iterator> index;
+    size_t cached;
+    // working storage, reused
+    std::vector<unsigned char> keep;
+    std::vector< std::pair<size_t, size_t> > todo;
+
+    void evict(lru_list::iterator it)
+    {
+      cached -= it->second.x.size();
+      index.erase(it->first);
+      lru.erase(it);
+    }
+
+    static std::uint64_t mix(std::uint64_t h, std::uint64_t v)
+    {
+      h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      return h;
+    }
+
+    std::uint64_t hash(size_t n, const float* x, const float* y, double sx, double sy) const
+    {
+      std::uint64_t h = mix(0, n), b;
+      for (size_t i=0; i<n; ++i) {
+	std::uint32_t u, v;
+	std::memcpy(&u, x+i, sizeof u);
+	std::memcpy(&v, y+i, sizeof v);
+	h = mix(h, (std::uint64_t(u) << 32) | v);
+      }
+      const double params[] = { sx, sy, tolerance };
+      for (size_t i=0; i<3; ++i) {
+	std::memcpy(&b, params+i, sizeof b);
+	h = mix(h, b);
+      }
+      return h;
+    }
+
+    // iterative Douglas-Peucker over an explicit work list, marking the
+    // vertices to keep; distances are to the segment, in pixels
+    void run(size_t n, const float* x, const float* y, double sx, double sy)
+    {
+      keep.assign(n, n < 3 || tolerance <= 0);
+      if (n < 3 || tolerance <= 0)
+	return;
+      keep[0] = keep[n-1] = 1;
+      const double tol2 = double(tolerance) * tolerance;
+      todo.clear();
+      todo.push_back(std::make_pair(size_t(0), n-1));
+      while (!todo.empty()) {
+	const size_t a = todo.back().first, b = todo.back().second;
+	todo.pop_back();
+	if (b < a+2)
+	  continue;
+	const double dx = (x[b]-x[a]) * sx, dy = (y[b]-y[a]) * sy;
+	const double len2 = dx*dx + dy*dy;
+	double dmax = -1;
+	size_t imax = a;
+	for (size_t i=a+1; i<b; ++i) {
+	  double px = (x[i]-x[a]) * sx, py = (y[i]-y[a]) * sy;
+	  if (len2 > 0) {
+	    const double t = std::min(1.0, std::max(0.0, (px*dx + py*dy) / len2));
+	    px -= t * dx;
+	    py -= t * dy;
+	  }
+	  const double d = px*px + py*py;
+	  if (d > dmax) {
+	    dmax = d;
+	    imax = i;
+	  }
+	}
+	if (dmax > tol2) {
+	  keep[imax] = 1;
+	  todo.push_back(std::make_pair(a, imax));
+	  todo.push_back(std::make_pair(imax, b));
+	}
+      }
+    }
+  };
+
+  // a point found by device::pick_nearest(): the draw_points/draw_lines
+  // call it came from (numbered from 0 since the index was last cleared),
+  // its position in that call's data, and its world coordinates
+  struct pick {
+    size_t series;
+    size_t index;
+    float x, y;
+  };
+
+  // k-d tree over plotted points for nearest-point queries, rebuilt
+  // lazily after points are added
+  class pick_index {
+  public:
+    pick_index() : built(0) { }
+
+    // start the points of a new series, returns its number
+    size_t begin_series()
+    {
+      starts.push_back(xs.size());
+      return starts.size() - 1;
+    }
+
+    void add(size_t n, const float* x, const float* y)
+    {
+      xs.insert(xs.end(), x, x+n);
+      ys.insert(ys.end(), y, y+n);
+    }
+
+    size_t size() const throw() { return xs.size(); }
+
+    void clear()
+    {
+      xs.clear();
+      ys.clear();
+      starts.clear();
+      tree.clear();
+      built = 0;
+    }
+
+    // nearest point to (x, y) within radius, distances being measured
+    // after scaling by sx and sy (pixels per world unit)
+    bool nearest(float x, float y, double radius, double sx, double sy, pick& result)
+    {
+      if (built != xs.size())
+	build();
+      double best = radius * radius;
+      size_t found = xs.size();
+
+      struct node { size_t lo, hi, depth; };
+      std::vector<node> todo(1, node{ 0, tree.size(), 0 });
+      while (!todo.empty()) {
+	const node nd = todo.back();
+	todo.pop_back();
+	if (nd.lo >= nd.hi)
+	  continue;
+	const size_t mid = nd.lo + (nd.hi-nd.lo) / 2;
+	const size_t p = tree[mid];
+	const double dx = (xs[p]-x) * sx, dy = (ys[p]-y) * sy;
+	const double d = dx*dx + dy*dy;
+	if (d <= best) {
+	  best = d;
+	  found = p;
+	}
+	// signed distance from the splitting plane; search the near side
+	// last so that it is popped first
+	const double split = nd.depth % 2 ? -dy : -dx;
+	const node below = { nd.lo, mid, nd.depth+1 }, above = { mid+1, nd.hi, nd.depth+1 };
+	// a NaN splits only NaNs, which sort last, from the rest
+	if (split != split) {
+	  todo.push_back(below);
+	  continue;
+	}
+	const bool near_below = split <= 0;
+	if (split * split <= best)
+	  todo.push_back(near_below ? above : below);
+	todo.push_back(near_below ? below : above);
+      }
+
+      if (found == xs.size())
+	return false;
+      result.series = std::upper_bound(starts.begin(), starts.end(), found) - starts.begin() - 1;
+      result.index = found - starts[result.series];
+      result.x = xs[found];
+      result.y = ys[found];
+      return true;
+    }
+
+  private:
+    std::vector<float> xs, ys;
+    std::vector<size_t> starts;	// first point of each series
+    std::vector<size_t> tree;	// point numbers in implicit k-d order
+    size_t built;		// points in the tree
+
+    void build()
+    {
+      tree.resize(xs.size());
+      for (size_t i=0; i<tree.size(); ++i)
+	tree[i] = i;
+      struct node { size_t lo, hi, depth; };
+      std::vector<node> todo(1, node{ 0, tree.size(), 0 });
+      while (!todo.empty()) {
+	const node nd = todo.back();
+	todo.pop_back();
+	if (nd.hi - nd.lo < 2)
+	  continue;
+	const size_t mid = nd.lo + (nd.hi-nd.lo) / 2;
+	const std::vector<float>& c = nd.depth % 2 ? ys : xs;
+	std::nth_element(tree.begin()+nd.lo, tree.begin()+mid, tree.begin()+nd.hi,
+			 [&c](size_t a, size_t b) {
+			   // NaNs sort last, keeping the ordering strict weak
+			   return c[a] < c[b] || (c[b] != c[b] && c[a] == c[a]);
+			 });
+	todo.push_back(node{ nd.lo, mid, nd.depth+1 });
+	todo.push_back(node{ mid+1, nd.hi, nd.depth+1 });
+      }
+      built = xs.size();
+    }
+  };
+
+  // string extents measured by PGPLOT, which lays out every character
+  // to measure a string, kept for device::text_length() and text_bbox()
+  class text_cache {
+  public:
+    size_t capacity;		// entries kept before starting over
+
+    text_cache() : capacity(4096), state_(0) { }
+
+    // the n values kept under key, or false and room for them to be
+    // filled in; all entries are dropped when state (a hash of whatever
+    // else the extents depend on) differs from the last call's
+    bool find(std::uint64_t state, const std::string& key, size_t n, float*& v)
+    {
+      if (state != state_) {
+	map_.clear();
+	state_ = state;
+      }
+      std::unordered_map<std::string, std::vector<float> >::iterator it = map_.find(key);
+      if (it != map_.end()) {
+	v = &it->second[0];
+	return true;
+      }
+      if (map_.size() >= capacity)
+	map_.clear();
+      std::vector<float>& e = map_[key];
+      e.resize(n);
+      v = &e[0];
+      return false;
+    }
+
+    void clear() { map_.clear(); }
+
+    size_t size() const throw() { return map_.size(); }
+
+  private:
+    std::unordered_map<std::string, std::vector<float> > map_;
+    std::uint64_t state_;
+  };
+
   namespace font {
     enum value { normal=1, roman=2, italic=3, script=4 };
   }
@@ -150,6 +730,47 @@ namespace pgplot {
 
   inline void end_batch() { cpgebuf(); }
 
+  // a colour table for device::ctab(): n levels l in [0,1], increasing,
+  // with their red, green and blue intensities
+  struct colormap {
+    const float* l;
+    const float* r;
+    const float* g;
+    const float* b;
+    int n;
+  };
+
+  // built-in colour tables, passed to cpgctab as they are
+  namespace colormaps {
+
+    constexpr float gray_l[] = { 0, 1 };
+    constexpr float gray_c[] = { 0, 1 };
+    constexpr colormap gray = { gray_l, gray_c, gray_c, gray_c, 2 };
+
+    // black through red and yellow to white, as in the PGPLOT demos
+    constexpr float heat_l[] = { 0.0, 0.2, 0.4, 0.6, 1.0 };
+    constexpr float heat_r[] = { 0.0, 0.5, 1.0, 1.0, 1.0 };
+    constexpr float heat_g[] = { 0.0, 0.0, 0.5, 1.0, 1.0 };
+    constexpr float heat_b[] = { 0.0, 0.0, 0.0, 0.3, 1.0 };
+    constexpr colormap heat = { heat_l, heat_r, heat_g, heat_b, 5 };
+
+    constexpr float rainbow_l[] = { -0.5, 0.0, 0.17, 0.33, 0.50, 0.67, 0.83, 1.0, 1.7 };
+    constexpr float rainbow_r[] = { 0.0, 0.0, 0.0, 0.0, 0.6, 1.0, 1.0, 1.0, 1.0 };
+    constexpr float rainbow_g[] = { 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 0.6, 0.0, 1.0 };
+    constexpr float rainbow_b[] = { 0.0, 0.3, 0.8, 1.0, 0.3, 0.0, 0.0, 0.0, 1.0 };
+    constexpr colormap rainbow = { rainbow_l, rainbow_r, rainbow_g, rainbow_b, 9 };
+
+    // matplotlib's viridis at nine levels
+    constexpr float viridis_l[] = { 0.0, 0.125, 0.25, 0.375, 0.5, 0.625, 0.75, 0.875, 1.0 };
+    constexpr float viridis_r[] = { 0.267004, 0.282623, 0.229739, 0.172719, 0.127568,
+				    0.157851, 0.369214, 0.678489, 0.993248 };
+    constexpr float viridis_g[] = { 0.004874, 0.140926, 0.322361, 0.448791, 0.566949,
+				    0.683765, 0.788888, 0.863742, 0.906157 };
+    constexpr float viridis_b[] = { 0.329415, 0.457517, 0.545706, 0.557885, 0.550556,
+				    0.501686, 0.382914, 0.189503, 0.143936 };
+    constexpr colormap viridis = { viridis_l, viridis_r, viridis_g, viridis_b, 9 };
+  }
+
   // exception thrown when pgopen() fails
   class open_error : public std::runtime_error {
   public:
@@ -160,35 +781,779 @@ namespace pgplot {
   private:
     int id_;
     std::string devname_;
+    // transforms applied to x and y data by the array drawing calls
+    mutable transform xdata_, ydata_;
     // make copy ctor and copy assignment inaccessible
     device(const device&);
     device& operator=(const device&);
 
+  protected:
+    // end the output; id() is 0 afterwards
+    void close() throw()
+    {
+      if (id_ <= 0)
+	return;
+      int current_device;
+      cpgqid(&current_device);
+      cpgslct(id_);
+      cpgclos();
+      if (current_device != id_ && current_device != 0)
+	cpgslct(current_device);
+      id_ = 0;
+    }
+
+  private:
+    // the data transforms with log10 switched on by an axis::xlog,
+    // axis::ylog or axis::log flag
+    transform x_transform(axis::value log) const throw()
+    {
+      transform t = xdata_;
+      t.log = t.log || log == axis::xlog || log == axis::log;
+      return t;
+    }
+
+    transform y_transform(axis::value log) const throw()
+    {
+      transform t = ydata_;
+      t.log = t.log || log == axis::ylog || log == axis::log;
+      return t;
+    }
+
+    // the colour table last loaded by ctab(), 0 if unknown
+    mutable std::uint64_t ctab_;
+
+    // load a colour table unless it is the one loaded last
+    void load_ctab(const float* l, const float* r, const float* g, const float* b, int n,
+		   float contrast, float bright) const throw()
+    {
+      const size_t bytes = n * sizeof(float);
+      std::uint64_t h = detail::hash_bytes(&n, sizeof n);
+      h = detail::hash_bytes(l, bytes, h);
+      h = detail::hash_bytes(r, bytes, h);
+      h = detail::hash_bytes(g, bytes, h);
+      h = detail::hash_bytes(b, bytes, h);
+      h = detail::hash_bytes(&contrast, sizeof contrast, h);
+      h = detail::hash_bytes(&bright, sizeof bright, h) | 1;
+      select();
+      if (h == ctab_)
+	return;
+      cpgctab(l, r, g, b, n, contrast, bright);
+      ctab_ = h;
+    }
+
+    // reused across calls by the streaming drawing calls
+    mutable std::vector<float> chunkbuf_;
+    // optional simplification of draw_lines/draw_poly input
+    mutable simplifier simplify_;
+    // draw_lines breaks where x jumps by more than this, if positive
+    mutable float line_gap_;
+    // optional index of the points drawn, for pick_nearest()
+    mutable bool picking_;
+    mutable pick_index picks_;
+    // measured text extents
+    mutable text_cache texts_;
+
+    // what text extents depend on besides the string, font and height:
+    // the view surface, viewport and window
+    std::uint64_t text_state() const throw()
+    {
+      float v[12];
+      cpgqvsz(unit::pixel, v, v+1, v+2, v+3);
+      cpgqvp(unit::pixel, v+4, v+5, v+6, v+7);
+      cpgqwin(v+8, v+9, v+10, v+11);
+      return detail::hash_bytes(v, sizeof v);
+    }
+
+    // text followed by the current font and height and the n params
+    std::string text_key(const std::string& text, const float* params, size_t n) const
+    {
+      std::string key(text);
+      float height;
+      int font;
+      cpgqch(&height);
+      cpgqcf(&font);
+      key += '\0';
+      key.append(reinterpret_cast<const char*>(&height), sizeof height);
+      key.append(reinterpret_cast<const char*>(&font), sizeof font);
+      key.append(reinterpret_cast<const char*>(params), n * sizeof(float));
+      return key;
+    }
+
+    // record a chunk in the pick index; skip drops the point a polyline
+    // chunk repeats from the previous one
+    void index_points(int n, const float* x, const float* y, bool skip) const
+    {
+      if (skip && n > 0) {
+	--n;
+	++x;
+	++y;
+      }
+      picks_.add(n, x, y);
+    }
+
+    static void cpglcur_(int maxpt, int* npt, float* x, float* y, int)
+    {
+      cpglcur(maxpt, npt, x, y);
+    }
+
+    template<typename F>
+    void cursor_input(F f, int maxpt, std::vector<float>& x, std::vector<float>& y,
+		      int symbol, float snap_pixels) const
+    {
+      // the points already entered, which the cursor routines take as
+      // at most maxpt
+      int npt = std::min<size_t>(std::min(x.size(), y.size()), std::max(maxpt, 0));
+      x.resize(npt);
+      y.resize(npt);
+      x.resize(std::max(maxpt, 1));
+      y.resize(std::max(maxpt, 1));
+      select();
+      f(maxpt, &npt, &x[0], &y[0], symbol);
+      x.resize(npt);
+      y.resize(npt);
+      snap(npt, x.empty() ? 0 : &x[0], y.empty() ? 0 : &y[0], snap_pixels);
+    }
+
+    // snap the n points at x, y to the nearest indexed points
+    void snap(int n, float* x, float* y, float pixels) const
+    {
+      pick p;
+      for (int i=0; pixels > 0 && i<n; ++i)
+	if (pick_nearest(x[i], y[i], pixels, p)) {
+	  x[i] = p.x;
+	  y[i] = p.y;
+	}
+    }
+
+    // pixels per world unit in x and y
+    void pixel_scale(double& sx, double& sy) const throw()
+    {
+      float px1, px2, py1, py2, wx1, wx2, wy1, wy2;
+      cpgqvp(unit::pixel, &px1, &px2, &py1, &py2);
+      cpgqwin(&wx1, &wx2, &wy1, &wy2);
+      sx = wx2 != wx1 ? (px2-px1) / (wx2-wx1) : 0;
+      sy = wy2 != wy1 ? (py2-py1) / (wy2-wy1) : 0;
+    }
+
+    // the vertices to draw, after simplification when that is enabled
+    int simplified(int n, const float*& x, const float*& y) const
+    {
+      if (simplify_.tolerance <= 0)
+	return n;
+      double sx, sy;
+      pixel_scale(sx, sy);
+      return simplify_.apply(n, x, y, sx, sy, x, y);
+    }
+
+    // per-chunk drawing functions for stream(), which also feed the pick
+    // index when that is enabled
+    struct lines_drawer_t {
+      const device* dev;
+      bool more;
+      // the chunk as separate polylines, broken at non-finite points and
+      // at jumps in x wider than the line gap, in one pass over it; the
+      // pick index gets every point, non-finite ones included, so that
+      // pick::index stays the position in the caller's data
+      void operator()(int k, const float* x, const float* y)
+      {
+	if (dev->picking_)
+	  dev->index_points(k, x, y, more);
+	const float gap = dev->line_gap_;
+	int b = 0;
+	for (int i=0; i<=k; ++i) {
+	  const bool bad = i < k && !(std::isfinite(x[i]) && std::isfinite(y[i]));
+	  const bool jump = i < k && gap > 0 && i > b && std::fabs(x[i] - x[i-1]) > gap;
+	  if (i < k && !bad && !jump)
+	    continue;
+	  if (i-b > 1)
+	    dev->polyline(i-b, x+b, y+b);
+	  b = bad ? i+1 : i;
+	}
+	more = true;
+      }
+    };
+
+    lines_drawer_t lines_drawer() const
+    {
+      if (picking_)
+	picks_.begin_series();
+      lines_drawer_t f = { this, false };
+      return f;
+    }
+
+    struct points_drawer_t {
+      const device* dev;
+      int symbol;
+      void operator()(int k, const float* x, const float* y)
+      {
+	if (dev->picking_)
+	  dev->index_points(k, x, y, false);
+	cpgpt(k, x, y, symbol);
+      }
+    };
+
+    points_drawer_t points_drawer(int symbol) const
+    {
+      if (picking_)
+	picks_.begin_series();
+      points_drawer_t f = { this, symbol };
+      return f;
+    }
+
+    void polyline(int n, const float* x, const float* y) const
+    {
+      n = simplified(n, x, y);
+      cpgline(n, x, y);
+    }
+
+    void poly(int n, const float* x, const float* y) const
+    {
+      n = simplified(n, x, y);
+      cpgpoly(n, x, y);
+    }
+
+    // chunk size actually used, kept within the int that cpg routines take
+    static size_t chunk() throw()
+    {
+      const size_t maxint = 2147483646;
+      return std::max<size_t>(1, std::min(chunk_size, maxint));
+    }
+
+    float* chunk_buffer(int arrays) const
+    {
+      const size_t need = arrays * (chunk() + 1);
+      if (chunkbuf_.size() < need)
+	chunkbuf_.resize(need);
+      return &chunkbuf_[0];
+    }
+
+    // point count for the cpg routines that cannot be streamed
+    static int count(size_t n)
+    {
+      if (n > 2147483647)
+	throw std::length_error("pgplot: too many points for a single PGPLOT call");
+      return n;
+    }
+
+    // convert two arrays chunk by chunk and pass each chunk to f(k, x, y);
+    // with overlap the last point of a chunk starts the next, so that
+    // polylines stay connected
+    template<typename S1, typename S2, typename F>
+    void stream(size_t n, bool overlap,
+		const S1& s1, const transform& f1,
+		const S2& s2, const transform& f2, F f) const
+    {
+      const size_t m = chunk();
+      float* buf = chunk_buffer(2);
+      select();
+      for (size_t pos=0; pos<n; ) {
+	const size_t k = std::min(overlap ? m+1 : m, n-pos);
+	f(int(k),
+	  detail::slice(s1, pos, k, buf, f1),
+	  detail::slice(s2, pos, k, buf+m+1, f2));
+	if (pos + k >= n)
+	  break;
+	pos += overlap ? k-1 : k;
+      }
+    }
+
+    template<typename S1, typename S2, typename S3, typename F>
+    void stream(size_t n,
+		const S1& s1, const transform& f1,
+		const S2& s2, const transform& f2,
+		const S3& s3, const transform& f3, F f) const
+    {
+      const size_t m = chunk();
+      float* buf = chunk_buffer(3);
+      select();
+      for (size_t pos=0; pos<n; pos+=m) {
+	const size_t k = std::min(m, n-pos);
+	f(int(k),
+	  detail::slice(s1, pos, k, buf, f1),
+	  detail::slice(s2, pos, k, buf+m+1, f2),
+	  detail::slice(s3, pos, k, buf+2*(m+1), f3));
+      }
+    }
+
+    // stream a lazily evaluated source, chunk by chunk as for stream();
+    // with overlap the last point is carried over rather than re-read, as
+    // the source may be single-pass
+    template<typename S, typename F>
+    void stream_source(S& src, bool overlap, F f) const
+    {
+      const size_t m = chunk();
+      float* x = chunk_buffer(2);
+      float* y = x + m+1;
+      const size_t first = overlap ? 1 : 0;
+      size_t k = src.fill(x, y, m+first, xdata_, ydata_);
+      select();
+      while (k > first) {
+	f(int(k), x, y);
+	if (overlap) {
+	  x[0] = x[k-1];
+	  y[0] = y[k-1];
+	}
+	k = first + src.fill(x+first, y+first, m, xdata_, ydata_);
+      }
+    }
+
+    // error bars with log10 fused into the conversion: a bar along a log
+    // axis spans log10(v-e) to log10(v+e), so symmetric bars are drawn
+    // with cpgerrx/cpgerry from the two bounds
+    template<typename S1, typename S2, typename S3>
+    void errbar_log(err::value dir, size_t n, const S1& x, const S2& y, const S3& e,
+		    float t, axis::value log) const
+    {
+      const bool along_x = dir == err::plusx || dir == err::minusx || dir == err::x;
+      const bool both = dir == err::x || dir == err::y;
+      const transform bf = along_x ? x_transform(log) : y_transform(log);
+      const transform of = along_x ? y_transform(log) : x_transform(log);
+
+      // a: centre or lower bound, b: bar length or upper bound
+      const size_t m = chunk();
+      float* a = chunk_buffer(3);
+      float* b = a + m+1;
+      float* o = b + m+1;
+
+      select();
+      // an end at or below zero has no log: the bar runs to the window's
+      // edge instead; only bars whose centre has none are left out
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      const float edge = bf.scale < 0 ? (along_x ? wx2 : wy2) : (along_x ? wx1 : wy1);
+      const auto end_of = [&](double u) {
+	const float f = bf(u);
+	return std::isfinite(f) ? f : edge;
+      };
+      for (size_t pos=0; pos<n; pos+=m) {
+	const size_t end = std::min(m, n-pos);
+	size_t k = 0;
+	for (size_t i=0; i<end; ++i) {
+	  const double v = along_x ? x[pos+i] : y[pos+i];
+	  const double ev = e[pos+i];
+	  const float c = bf(v);
+	  o[k] = of(along_x ? y[pos+i] : x[pos+i]);
+	  if (!bf.log) {
+	    a[k] = c;
+	    b[k] = ev * bf.scale;
+	  }
+	  else if (both) {
+	    a[k] = end_of(v - ev);
+	    b[k] = end_of(v + ev);
+	  }
+	  else {
+	    a[k] = c;
+	    b[k] = dir == err::plusx || dir == err::plusy ? end_of(v + ev) - c : c - end_of(v - ev);
+	  }
+	  if (std::isfinite(o[k]) && std::isfinite(c) && std::isfinite(a[k]) && std::isfinite(b[k]))
+	    ++k;
+	}
+	if (!k)
+	  continue;
+
+	if (!bf.log || !both)
+	  cpgerrb(dir, k, along_x ? a : o, along_x ? o : a, b, t);
+	else if (along_x)
+	  cpgerrx(k, a, b, o, t);
+	else
+	  cpgerry(k, o, a, b, t);
+      }
+    }
+
+    // error bars from a value and the errors below and above it, bounds
+    // computed and put through the data transform in one pass; bars off
+    // the window or not finite are dropped, and with merge a two-sided bar
+    // in the same pixel column (row for x bars) as the one before it and
+    // overlapping it is folded into it
+    template<typename S1, typename S2, typename S3, typename S4>
+    void errbars_(err::value dir, size_t n, const S1& x, const S2& y,
+		  const S3& minus, const S4& plus, float t, bool merge) const
+    {
+      const bool along_x = dir == err::plusx || dir == err::minusx || dir == err::x;
+      const bool both = dir == err::x || dir == err::y;
+      const transform& bf = along_x ? xdata_ : ydata_;
+      const transform& of = along_x ? ydata_ : xdata_;
+
+      select();
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      const float b1 = along_x ? wx1 : wy1, b2 = along_x ? wx2 : wy2;
+      const float o1 = along_x ? wy1 : wx1, o2 = along_x ? wy2 : wx2;
+      double sx, sy;
+      pixel_scale(sx, sy);
+      const double pixels = std::fabs(along_x ? sy : sx);
+      // on a log axis an end at or below zero is taken to the window's
+      // edge; only bars whose centre has no log are dropped
+      const float edge = bf.scale < 0 ? b2 : b1;
+      const auto end_of = [&](double u) {
+	const float f = bf(u);
+	return std::isfinite(f) || !bf.log ? f : edge;
+      };
+
+      // o: other coordinate; two-sided lo, hi: bounds, in order;
+      // one-sided lo: centre, hi: signed length
+      const size_t m = chunk();
+      float* o = chunk_buffer(3);
+      float* lo = o + m+1;
+      float* hi = lo + m+1;
+      size_t k = 0;
+      double last = 0;
+      for (size_t i=0; i<n; ++i) {
+	const double v = along_x ? x[i] : y[i];
+	const float oi = of(along_x ? y[i] : x[i]);
+	const float c = bf(v);
+	float l, h, end;
+	if (both) {
+	  l = end_of(v - minus[i]);
+	  h = end = end_of(v + plus[i]);
+	}
+	else if (dir == err::plusx || dir == err::plusy) {
+	  l = c;
+	  end = end_of(v + plus[i]);
+	  h = end - l;
+	}
+	else {
+	  l = c;
+	  end = end_of(v - minus[i]);
+	  h = l - end;
+	}
+	const float e1 = std::min(l, end), e2 = std::max(l, end);
+	if (!(oi >= o1 && oi <= o2 && e2 >= b1 && e1 <= b2
+	      && std::isfinite(c) && std::isfinite(l) && std::isfinite(h)))
+	  continue;
+
+	const double column = std::floor(oi * pixels);
+	if (merge && both && k && column == last
+	    && e1 <= hi[k-1] && e2 >= lo[k-1]) {
+	  lo[k-1] = std::min(lo[k-1], e1);
+	  hi[k-1] = std::max(hi[k-1], e2);
+	  continue;
+	}
+	if (k == m) {
+	  errbars_flush(dir, k, o, lo, hi, t);
+	  k = 0;
+	}
+	o[k] = oi;
+	lo[k] = both ? e1 : l;
+	hi[k] = both ? e2 : h;
+	last = column;
+	++k;
+      }
+      errbars_flush(dir, k, o, lo, hi, t);
+    }
+
+    void errbars_flush(err::value dir, size_t k, const float* o, const float* lo, const float* hi,
+		       float t) const
+    {
+      if (!k)
+	return;
+      if (dir == err::x)
+	cpgerrx(int(k), lo, hi, o, t);
+      else if (dir == err::y)
+	cpgerry(int(k), o, lo, hi, t);
+      else if (dir == err::plusx || dir == err::minusx)
+	cpgerrb(dir, int(k), lo, o, hi, t);
+      else
+	cpgerrb(dir, int(k), o, lo, hi, t);
+    }
+
+    // error bar lengths are differences, so only the scale applies (for
+    // linear transforms; errbar() sends log ones to errbar_log)
+    transform error_transform(err::value dir) const throw()
+    {
+      switch (dir) {
+      case err::plusx: case err::minusx: case err::x:
+	return transform(0, xdata_.scale);
+      default:
+	return transform(0, ydata_.scale);
+      }
+    }
+
+    // the window as x1 <= x2, y1 <= y2, widened by the given margins
+    void window_box(float& x1, float& x2, float& y1, float& y2, float mx = 0, float my = 0)
+      const throw()
+    {
+      cpgqwin(&x1, &x2, &y1, &y2);
+      if (x1 > x2)
+	std::swap(x1, x2);
+      if (y1 > y2)
+	std::swap(y1, y2);
+      x1 -= mx;
+      x2 += mx;
+      y1 -= my;
+      y2 += my;
+    }
+
+    // whether the boxes x1..x2, y1..y2 (in either order) and the window
+    // wx1..wx2, wy1..wy2 meet
+    static bool visible(float x1, float x2, float y1, float y2,
+			float wx1, float wx2, float wy1, float wy2) throw()
+    {
+      return std::max(x1, x2) >= wx1 && std::min(x1, x2) <= wx2
+	&& std::max(y1, y2) >= wy1 && std::min(y1, y2) <= wy2;
+    }
+
+    void circles(size_t n, const float* x, const float* y, const float* r, bool cull) const
+    {
+      select();
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      cpgbbuf();
+      for (size_t i=0; i<n; ++i)
+	if (!cull || visible(x[i]-r[i], x[i]+r[i], y[i]-r[i], y[i]+r[i], wx1, wx2, wy1, wy2))
+	  cpgcirc(x[i], y[i], r[i]);
+      cpgebuf();
+    }
+
+    void rectangles(size_t n, const float* x1, const float* x2, const float* y1, const float* y2,
+		    bool cull) const
+    {
+      select();
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      cpgbbuf();
+      for (size_t i=0; i<n; ++i)
+	if (!cull || visible(x1[i], x2[i], y1[i], y2[i], wx1, wx2, wy1, wy2))
+	  cpgrect(x1[i], x2[i], y1[i], y2[i]);
+      cpgebuf();
+    }
+
+    void arrows(size_t n, const float* x1, const float* y1, const float* x2, const float* y2,
+		bool cull) const
+    {
+      select();
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      cpgbbuf();
+      for (size_t i=0; i<n; ++i)
+	if (!cull || visible(x1[i], x2[i], y1[i], y2[i], wx1, wx2, wy1, wy2))
+	  cpgarro(x1[i], y1[i], x2[i], y2[i]);
+      cpgebuf();
+    }
+
+    void polys(size_t n, const float* x, const float* y,
+	       size_t npoly, const size_t* offsets, const int* ci, bool dots) const
+    {
+      select();
+      float wx1, wx2, wy1, wy2;
+      window_box(wx1, wx2, wy1, wy2);
+      double sx, sy;
+      pixel_scale(sx, sy);
+
+      // what survives: n vertices from start in x, y, or in the clipped
+      // buffers cx, cy if clipped; a dot is one vertex in cx, cy
+      struct piece {
+	int ci;
+	bool clipped;
+	size_t start, n;
+      };
+      std::vector<piece> pieces;
+      std::vector<float> cx, cy, px, py, tx, ty;
+      for (size_t k=0; k<npoly; ++k) {
+	const size_t b = std::min(offsets[k], n);
+	const size_t e = k+1 < npoly ? std::min(std::max(offsets[k+1], b), n) : n;
+	if (e - b < 3)
+	  continue;
+	float x1 = x[b], x2 = x[b], y1 = y[b], y2 = y[b];
+	for (size_t i=b+1; i<e; ++i) {
+	  x1 = std::min(x1, x[i]);
+	  x2 = std::max(x2, x[i]);
+	  y1 = std::min(y1, y[i]);
+	  y2 = std::max(y2, y[i]);
+	}
+	if (!visible(x1, x2, y1, y2, wx1, wx2, wy1, wy2))
+	  continue;
+	if ((x2-x1) * std::fabs(sx) < 1 && (y2-y1) * std::fabs(sy) < 1) {
+	  if (dots) {
+	    piece p = { ci[k], true, cx.size(), 1 };
+	    pieces.push_back(p);
+	    cx.push_back((x1+x2) / 2);
+	    cy.push_back((y1+y2) / 2);
+	  }
+	  continue;
+	}
+	if (x1 >= wx1 && x2 <= wx2 && y1 >= wy1 && y2 <= wy2) {
+	  piece p = { ci[k], false, b, e-b };
+	  pieces.push_back(p);
+	  continue;
+	}
+	detail::clip_polygon(e-b, x+b, y+b, wx1, wx2, wy1, wy2, px, py, tx, ty);
+	if (px.size() >= 3) {
+	  piece p = { ci[k], true, cx.size(), px.size() };
+	  pieces.push_back(p);
+	  cx.insert(cx.end(), px.begin(), px.end());
+	  cy.insert(cy.end(), py.begin(), py.end());
+	}
+      }
+      std::stable_sort(pieces.begin(), pieces.end(),
+		       [](const piece& a, const piece& b) { return a.ci < b.ci; });
+
+      int saved_ci;
+      cpgqci(&saved_ci);
+      cpgbbuf();
+      for (size_t g=0; g<pieces.size(); ) {
+	const int c = pieces[g].ci;
+	cpgsci(c);
+	px.clear();
+	py.clear();
+	for (; g<pieces.size() && pieces[g].ci == c; ++g) {
+	  const piece& p = pieces[g];
+	  if (p.n == 1) {
+	    px.push_back(cx[p.start]);
+	    py.push_back(cy[p.start]);
+	  }
+	  else if (p.clipped)
+	    poly(count(p.n), &cx[p.start], &cy[p.start]);
+	  else
+	    poly(count(p.n), x + p.start, y + p.start);
+	}
+	if (!px.empty())
+	  cpgpt(count(px.size()), &px[0], &py[0], -1);
+      }
+      cpgebuf();
+      cpgsci(saved_ci);
+    }
+
+    // ns symbols for n points; as PGPNTS, the last is used for the rest
+    void markers(size_t n, const float* x, const float* y, const int* symbols, size_t ns,
+		 bool cull) const
+    {
+      select();
+      if (!ns)
+	return;
+      if (!cull) {
+	cpgpnts(count(n), x, y, symbols, count(ns));
+	return;
+      }
+      // a character height of margin for the marker itself
+      float xch, ych, wx1, wx2, wy1, wy2;
+      cpgqcs(unit::world, &xch, &ych);
+      window_box(wx1, wx2, wy1, wy2, xch, ych);
+      std::vector<float> vx, vy;
+      std::vector<int> vs;
+      for (size_t i=0; i<n; ++i)
+	if (x[i] >= wx1 && x[i] <= wx2 && y[i] >= wy1 && y[i] <= wy2) {
+	  vx.push_back(x[i]);
+	  vy.push_back(y[i]);
+	  vs.push_back(symbols[std::min(i, ns-1)]);
+	}
+      if (!vx.empty())
+	cpgpnts(count(vx.size()), &vx[0], &vy[0], &vs[0], count(vs.size()));
+    }
+
   public:
 
     explicit device(const std::string& devname =
 		    std::getenv("PGPLOT_DEV") ? std::getenv("PGPLOT_DEV") : "?"
 		    ) :
-      devname_(devname)
+      devname_(devname), ctab_(0), line_gap_(0), picking_(false)
     {
       id_ = cpgopen(devname_.c_str());
       if (id_ <= 0)
 	throw open_error(std::string("failed to open device '") + devname_ + "'");
     }
 
-    virtual ~device() {
-      int current_device;
-      cpgqid(&current_device);
-      cpgslct(id());
-      cpgclos();
-      if (current_device != id() && current_device != 0)
-	cpgslct(current_device);
+    // a moved-from device is left closed, with id() 0
+    device(device&& other) throw()
+      : id_(other.id_), devname_(std::move(other.devname_)),
+	xdata_(other.xdata_), ydata_(other.ydata_), ctab_(other.ctab_),
+	chunkbuf_(std::move(other.chunkbuf_)), simplify_(std::move(other.simplify_)),
+	line_gap_(other.line_gap_), picking_(other.picking_), picks_(std::move(other.picks_)), texts_(std::move(other.texts_))
+    {
+      other.id_ = 0;
     }
 
+    device& operator=(device&& other) throw()
+    {
+      if (this != &other) {
+	close();
+	id_ = other.id_;
+	other.id_ = 0;
+	devname_ = std::move(other.devname_);
+	xdata_ = other.xdata_;
+	ydata_ = other.ydata_;
+	ctab_ = other.ctab_;
+	chunkbuf_ = std::move(other.chunkbuf_);
+	simplify_ = std::move(other.simplify_);
+	line_gap_ = other.line_gap_;
+	picking_ = other.picking_;
+	picks_ = std::move(other.picks_);
+	texts_ = std::move(other.texts_);
+      }
+      return *this;
+    }
+
+    virtual ~device() { close(); }
+
     int id() const throw() { return id_; }
 
     void select() const throw() { cpgslct(id()); }
 
+    // opt-in simplification of draw_lines and draw_poly input: vertices
+    // are dropped while the drawn shape stays within tolerance device
+    // pixels of the original; 0 disables.  Results for up to cache_points
+    // points are kept for redraws of unchanged data at the same scale.
+    void set_simplify(float tolerance, size_t cache_points = 1 << 20) const
+    {
+      simplify_.tolerance = tolerance;
+      simplify_.capacity = cache_points;
+      if (tolerance <= 0)
+	simplify_.clear();
+    }
+
+    float get_simplify() const throw() { return simplify_.tolerance; }
+
+    // draw_lines always leaves a gap at NaN or infinite points; with gap
+    // positive it also breaks the line where x jumps by more than gap
+    // (world units, after the data transform).  0 disables.
+    void set_line_gap(float gap) const throw() { line_gap_ = gap; }
+
+    float get_line_gap() const throw() { return line_gap_; }
+
+    // opt-in index of the points passed to draw_points and draw_lines
+    // (in world coordinates), for pick_nearest(); cleared by page()
+    void set_pick_index(bool state) const
+    {
+      picking_ = state;
+      if (!state)
+	picks_.clear();
+    }
+
+    void clear_pick_index() const { picks_.clear(); }
+
+    // the indexed point nearest to world (x, y) and at most radius device
+    // pixels away, in O(log n) once the index is built
+    bool pick_nearest(float x, float y, float radius, pick& result) const
+    {
+      select();
+      double sx, sy;
+      pixel_scale(sx, sy);
+      return picks_.nearest(x, y, radius, std::abs(sx), std::abs(sy), result);
+    }
+
+    // read the cursor and pick the nearest indexed point to it
+    bool pick_cursor(float radius, pick& result, char& ch) const
+    {
+      float x1, x2, y1, y2;
+      get_window_boundary(x1, x2, y1, y2);
+      float x = (x1 + x2) / 2, y = (y1 + y2) / 2;
+      return get_cursor_pos(x, y, ch) && pick_nearest(x, y, radius, result);
+    }
+
+    // offset/scale applied to x and y data arrays while they are
+    // converted to float, see class transform
+    void set_data_transform(const transform& x, const transform& y) const throw()
+    {
+      xdata_ = x;
+      ydata_ = y;
+    }
+
+    void get_data_transform(transform& x, transform& y) const throw()
+    {
+      x = xdata_;
+      y = ydata_;
+    }
+
     void draw_arrow(float x1, float y1, float x2, float y2) const throw()
     {
       select();
@@ -225,21 +1590,21 @@ namespace pgplot {
     }
 
     template<typename T1, typename T2>
-    void hist(T1 v1, T2 v2, bool center) const
+    void hist(const T1& v1, const T2& v2, bool center) const
     {
-      auto_float d1(v1);
+      auto_float d1(v1, xdata_);
       auto_float d2(v2);
       select();
-      cpgbin(d1.n, d1.data, d2.data, center);
+      cpgbin(count(d1.n), d1.data, d2.data, center);
     }
 
     template<typename T1, typename T2>
     void hist(size_t n, const T1* p1, const T2* p2, bool center) const
     {
-      auto_float d1(n, p1);
+      auto_float d1(n, p1, xdata_);
       auto_float d2(n, p2);
       select();
-      cpgbin(d1.n, d1.data, d2.data, center);
+      cpgbin(count(d1.n), d1.data, d2.data, center);
     }
 
     void box(const std::string& xopt, float xtick, int xsub,
@@ -264,15 +1629,16 @@ namespace pgplot {
     // FIXME: PGCONT()
     // FIXME: PGCONX()
 
+    // a call repeating the table, contrast and brightness loaded last is
+    // skipped; set_color_rep*() and set_color_range() start afresh
     template<typename T1, typename T2, typename T3, typename T4>
-    void ctab(T1 v1, T2 v2, T3 v3, T4 v4, float contrast, float bright) const
+    void ctab(const T1& v1, const T2& v2, const T3& v3, const T4& v4, float contrast, float bright) const
     {
       auto_float l(v1);
       auto_float r(v2);
       auto_float g(v3);
       auto_float b(v4);
-      select();
-      cpgctab(l.data, r.data, g.data, b.data, l.n, contrast, bright);
+      load_ctab(l.data, r.data, g.data, b.data, count(l.n), contrast, bright);
     }
     template<typename T1, typename T2, typename T3, typename T4>
     void ctab(const T1* p1, const T2* p2, const T3* p3, const T4* p4, size_t n, float contrast, float bright) const
@@ -281,8 +1647,13 @@ namespace pgplot {
       auto_float r(n, p2);
       auto_float g(n, p3);
       auto_float b(n, p4);
-      select();
-      cpgctab(l.data, r.data, g.data, b.data, n, contrast, bright);
+      load_ctab(l.data, r.data, g.data, b.data, count(n), contrast, bright);
+    }
+
+    // one of the tables in pgplot::colormaps, or another of the same form
+    void ctab(const colormap& map, float contrast = 1, float bright = 0.5) const throw()
+    {
+      load_ctab(map.l, map.r, map.g, map.b, map.n, contrast, bright);
     }
 
     bool get_cursor_pos(float& x, float& y, char& ch) const throw()
@@ -304,6 +1675,13 @@ namespace pgplot {
       cpgenv(xmin,xmax,ymin,ymax,just,axis);
     }
 
+    // env() with limits given in untransformed data coordinates
+    void data_env(double xmin, double xmax, double ymin, double ymax, bool just, axis::value axis)
+      const throw()
+    {
+      env(xdata_(xmin), xdata_(xmax), ydata_(ymin), ydata_(ymax), just, axis);
+    }
+
     void erase() const throw()
     {
       select();
@@ -317,62 +1695,112 @@ namespace pgplot {
       cpgerr1(dir, x, y, e, t);
     }
 
+    // with a log data transform set the bars go through errbar_log, as
+    // their ends rather than their lengths must be transformed
     template<typename T1, typename T2, typename T3>
-    void errbar(err::value dir, T1 v1, T2 v2, T3 v3, float t) const
-    {
-      auto_float x(v1);
-      auto_float y(v2);
-      auto_float e(v3);
-      select();
-      cpgerrb(dir, x.n, x.data, y.data, e.data, t);
+    void errbar(err::value dir, const T1& v1, const T2& v2, const T3& v3, float t) const
+    {
+      if (xdata_.log || ydata_.log) {
+	errbar_log(dir, v1.size(), detail::data_of(v1), detail::data_of(v2), detail::data_of(v3),
+		   t, axis::none);
+	return;
+      }
+      stream(v1.size(), detail::data_of(v1), xdata_, detail::data_of(v2), ydata_,
+	     detail::data_of(v3), error_transform(dir),
+	     [=](int k, const float* x, const float* y, const float* e)
+	     { cpgerrb(dir, k, x, y, e, t); });
     }
     template<typename T1, typename T2, typename T3>
     void errbar(err::value dir, size_t n, const T1* p1, const T2* p2, const T3* p3, float t) const
     {
-      auto_float x(n, p1);
-      auto_float y(n, p2);
-      auto_float e(n, p3);
-      select();
-      cpgerrb(dir, n, x.data, y.data, e.data, t);
+      if (xdata_.log || ydata_.log) {
+	errbar_log(dir, n, p1, p2, p3, t, axis::none);
+	return;
+      }
+      stream(n, p1, xdata_, p2, ydata_, p3, error_transform(dir),
+	     [=](int k, const float* x, const float* y, const float* e)
+	     { cpgerrb(dir, k, x, y, e, t); });
     }
 
+    // log10 applied to the axes flagged by log (axis::xlog, ylog or log)
     template<typename T1, typename T2, typename T3>
-    void errbarx(T1 v1, T2 v2, T3 v3, float t) const
+    void errbar(err::value dir, const T1& v1, const T2& v2, const T3& v3, float t,
+		axis::value log) const
     {
-      auto_float x1(v1);
-      auto_float x2(v2);
-      auto_float y(v3);
-      select();
-      cpgerrx(x1.n, x1.data, x2.data, y.data, t);
+      errbar_log(dir, v1.size(), detail::data_of(v1), detail::data_of(v2), detail::data_of(v3), t, log);
     }
     template<typename T1, typename T2, typename T3>
-    void errbarx(size_t n, const T1* p1, const T2* p2, const T3* p3, float t) const
+    void errbar(err::value dir, size_t n, const T1* p1, const T2* p2, const T3* p3, float t,
+		axis::value log) const
     {
-      auto_float x1(n, p1);
-      auto_float x2(n, p2);
-      auto_float y(n, p3);
-      select();
-      cpgerrx(n, x1.data, x2.data, y.data, t);
+      errbar_log(dir, n, p1, p2, p3, t, log);
     }
 
     template<typename T1, typename T2, typename T3>
-    void errbary(T1 v1, T2 v2, T3 v3, float t) const
+    void errbarx(const T1& v1, const T2& v2, const T3& v3, float t) const
     {
-      auto_float x(v1);
-      auto_float y1(v2);
-      auto_float y2(v3);
-      select();
-      cpgerry(x.n, x.data, y1.data, y2.data, t);
+      stream(v1.size(), detail::data_of(v1), xdata_, detail::data_of(v2), xdata_,
+	     detail::data_of(v3), ydata_,
+	     [=](int k, const float* x1, const float* x2, const float* y)
+	     { cpgerrx(k, x1, x2, y, t); });
+    }
+    template<typename T1, typename T2, typename T3>
+    void errbarx(size_t n, const T1* p1, const T2* p2, const T3* p3, float t) const
+    {
+      stream(n, p1, xdata_, p2, xdata_, p3, ydata_,
+	     [=](int k, const float* x1, const float* x2, const float* y)
+	     { cpgerrx(k, x1, x2, y, t); });
     }
 
+    template<typename T1, typename T2, typename T3>
+    void errbary(const T1& v1, const T2& v2, const T3& v3, float t) const
+    {
+      stream(v1.size(), detail::data_of(v1), xdata_, detail::data_of(v2), ydata_,
+	     detail::data_of(v3), ydata_,
+	     [=](int k, const float* x, const float* y1, const float* y2)
+	     { cpgerry(k, x, y1, y2, t); });
+    }
     template<typename T1, typename T2, typename T3>
     void errbary(size_t n, const T1* p1, const T2* p2, const T3* p3, float t) const
     {
-      auto_float x(n, p1);
-      auto_float y1(n, p2);
-      auto_float y2(n, p3);
-      select();
-      cpgerry(n, x.data, y1.data, y2.data, t);
+      stream(n, p1, xdata_, p2, ydata_, p3, ydata_,
+	     [=](int k, const float* x, const float* y1, const float* y2)
+	     { cpgerry(k, x, y1, y2, t); });
+    }
+
+    // error bars of length e, in data units, at the points x, y: the
+    // bounds are worked out while converting, so no arrays of them are
+    // needed, and the data transform (including log) applies to the
+    // bounds.  Bars wholly off the window are skipped; with merge,
+    // overlapping two-sided bars of consecutive points that land in the
+    // same pixel column (row for x bars) are drawn as one, for dense data.
+    template<typename T1, typename T2, typename T3>
+    void errbars(err::value dir, const T1& v1, const T2& v2, const T3& v3, float t,
+		 bool merge = false) const
+    {
+      errbars_(dir, std::min(v1.size(), v2.size()), detail::data_of(v1), detail::data_of(v2),
+	       detail::data_of(v3), detail::data_of(v3), t, merge);
+    }
+    template<typename T1, typename T2, typename T3>
+    void errbars(err::value dir, size_t n, const T1* p1, const T2* p2, const T3* p3, float t,
+		 bool merge = false) const
+    {
+      errbars_(dir, n, p1, p2, p3, p3, t, merge);
+    }
+
+    // as errbars, with errors minus below and plus above the values
+    template<typename T1, typename T2, typename T3, typename T4>
+    void errbars_asymmetric(err::value dir, const T1& v1, const T2& v2, const T3& minus,
+			    const T4& plus, float t, bool merge = false) const
+    {
+      errbars_(dir, std::min(v1.size(), v2.size()), detail::data_of(v1), detail::data_of(v2),
+	       detail::data_of(minus), detail::data_of(plus), t, merge);
+    }
+    template<typename T1, typename T2, typename T3, typename T4>
+    void errbars_asymmetric(err::value dir, size_t n, const T1* p1, const T2* p2, const T3* minus,
+			    const T4* plus, float t, bool merge = false) const
+    {
+      errbars_(dir, n, p1, p2, minus, plus, t, merge);
     }
 
 
@@ -386,18 +1814,18 @@ namespace pgplot {
     // FIXME: PGHI2D()
 
     template<typename T1>
-    void hist(T1 v1, float min, float max, int nbin, int flag) const
+    void hist(const T1& v1, float min, float max, int nbin, int flag) const
     {
-      auto_float data(v1);
+      auto_float data(v1, xdata_);
       select();
-      cpghist(data.n, data.data, min, max, nbin, flag);
+      cpghist(count(data.n), data.data, min, max, nbin, flag);
     }
     template<typename T1>
     void hist(size_t n, const T1* p1, float min, float max, int nbin, int flag) const
     {
-      auto_float data(n, p1);
+      auto_float data(n, p1, xdata_);
       select();
-      cpghist(n, data.data, min, max, nbin, flag);
+      cpghist(count(n), data.data, min, max, nbin, flag);
     }
 
     void identity() const throw()
@@ -414,36 +1842,70 @@ namespace pgplot {
 	       ) const throw()
     {
       select();
-      cpglab(xlabel.c_str(), ylabel.c_str(), toplabel.c_str());
+      cpglab(xdata_.label(xlabel).c_str(), ydata_.label(ylabel).c_str(), toplabel.c_str());
     }
 
-    // FIXME: PGLCUR()
+    // PGLCUR: draw a polyline with the cursor; x and y hold the points
+    // already defined and return all of them, at most maxpt.  With snap
+    // the points are moved to indexed data within that many pixels.
+    void cursor_lines(int maxpt, std::vector<float>& x, std::vector<float>& y,
+		      float snap_pixels = 0) const
+    {
+      cursor_input(cpglcur_, maxpt, x, y, 0, snap_pixels);
+    }
 
     static void list_devices() throw() { cpgldev(); }
 
+    // measured once per string, font, height and units; the view
+    // surface, viewport or window changing starts over
     void text_length(unit::value units, const std::string& text, float& xl, float& yl)
-      const throw()
+      const
     {
       select();
-      cpglen(units, text.c_str(), &xl, &yl);
+      const float u = units;
+      float* v;
+      if (!texts_.find(text_state(), text_key(text, &u, 1), 2, v))
+	cpglen(units, text.c_str(), v, v+1);
+      xl = v[0];
+      yl = v[1];
     }
 
     template<typename T1, typename T2>
-    void draw_lines(T1 v1, T2 v2) const
+    void draw_lines(const T1& v1, const T2& v2) const
     {
-      auto_float d1(v1);
-      auto_float d2(v2);
-      select();
-      cpgline(d1.n, d1.data, d2.data);
+      stream(v1.size(), true, detail::data_of(v1), xdata_, detail::data_of(v2), ydata_,
+	     lines_drawer());
     }
 
     template<typename T1, typename T2>
     void draw_lines(size_t n, const T1* p1, const T2* p2) const
     {
-      auto_float d1(n, p1);
-      auto_float d2(n, p2);
-      select();
-      cpgline(d1.n, d1.data, d2.data);
+      stream(n, true, p1, xdata_, p2, ydata_, lines_drawer());
+    }
+
+    // log10 applied to the axes flagged by log (axis::xlog, ylog or log)
+    template<typename T1, typename T2>
+    void draw_lines(const T1& v1, const T2& v2, axis::value log) const
+    {
+      stream(v1.size(), true, detail::data_of(v1), x_transform(log),
+	     detail::data_of(v2), y_transform(log), lines_drawer());
+    }
+    template<typename T1, typename T2>
+    void draw_lines(size_t n, const T1* p1, const T2* p2, axis::value log) const
+    {
+      stream(n, true, p1, x_transform(log), p2, y_transform(log), lines_drawer());
+    }
+
+    // lazily evaluated points, see pgplot::range() and pgplot::generate()
+    template<typename It1, typename It2>
+    void draw_lines(iter_source<It1, It2> src) const
+    {
+      stream_source(src, true, lines_drawer());
+    }
+    template<typename F>
+    void draw_lines(generator<F> src) const
+    {
+      stream_source(src, true, lines_drawer());
     }
 
     void move_pen(float x, float y) const throw()
@@ -459,13 +1921,25 @@ namespace pgplot {
       cpgmtxt(side.c_str(), disp, coord, just, text.c_str());
     }
 
-    // FIXME: PGNCUR()
-    // FIXME: PGOLIN()
+    // PGNCUR: mark a sorted list of points with the cursor
+    void cursor_points(int maxpt, std::vector<float>& x, std::vector<float>& y,
+		       int symbol, float snap_pixels = 0) const
+    {
+      cursor_input(cpgncur, maxpt, x, y, symbol, snap_pixels);
+    }
+
+    // PGOLIN: mark an unordered list of points with the cursor
+    void cursor_outline(int maxpt, std::vector<float>& x, std::vector<float>& y,
+			int symbol, float snap_pixels = 0) const
+    {
+      cursor_input(cpgolin, maxpt, x, y, symbol, snap_pixels);
+    }
 
     void page() const throw()
     {
       select();
       cpgpage();
+      picks_.clear();
     }
 
     void panel(int x, int y) const throw()
@@ -480,41 +1954,100 @@ namespace pgplot {
       cpgpap(width, aspect);
     }
 
-    // FIXME: PGPIXL()
-    // FIXME: PGPNTS()
+    // colour indices ci[i + j*nx] as nx by ny cells filling the world
+    // rectangle x1..x2, y1..y2
+    void draw_pixels(const int* ci, int nx, int ny, float x1, float x2, float y1, float y2)
+      const throw()
+    {
+      select();
+      cpgpixl(ci, nx, ny, 1, nx, 1, ny, x1, x2, y1, y2);
+    }
+
+    void draw_pixels(const std::vector<int>& ci, int nx, int ny, float x1, float x2, float y1, float y2)
+      const throw()
+    {
+      draw_pixels(ci.empty() ? 0 : &ci[0], nx, ny, x1, x2, y1, y2);
+    }
+
 
     template<typename T1, typename T2>
-    void draw_poly(T1 v1, T2 v2) const
+    void draw_poly(const T1& v1, const T2& v2) const
     {
-      auto_float x(v1);
-      auto_float y(v2);
+      auto_float x(v1, xdata_);
+      auto_float y(v2, ydata_);
       select();
-      cpgpoly(x.n, x.data, y.data);
+      poly(count(x.n), x.data, y.data);
     }
     template<typename T1, typename T2>
     void draw_poly(size_t n, const T1* p1, const T2* p2) const
     {
-      auto_float x(n, p1);
-      auto_float y(n, p2);
+      auto_float x(n, p1, xdata_);
+      auto_float y(n, p2, ydata_);
       select();
-      cpgpoly(n, x.data, y.data);
+      poly(count(n), x.data, y.data);
     }
 
+    // many polygons in one call, e.g. the regions of a map: polygon k
+    // has the vertices from offsets[k] up to offsets[k+1], or to the end
+    // for the last, and colour index ci[k].  Polygons outside the window
+    // are skipped and those crossing its edge are clipped to it; those
+    // smaller than a pixel either way are drawn as a dot of their colour
+    // if dots is set, or dropped.  The fills are drawn grouped by colour,
+    // so overlapping polygons of different colours may stack in a
+    // different order from the one given.
     template<typename T1, typename T2>
-    void draw_points(T1 v1, T2 v2, int symbol) const
+    void draw_polys(const T1& v1, const T2& v2, const std::vector<size_t>& offsets,
+		    const std::vector<int>& ci, bool dots = true) const
     {
-      auto_float x(v1);
-      auto_float y(v2);
-      select();
-      cpgpt(x.n, x.data, y.data, symbol);
+      auto_float x(v1, xdata_);
+      auto_float y(v2, ydata_);
+      polys(std::min(x.n, y.n), x.data, y.data, std::min(offsets.size(), ci.size()),
+	    offsets.empty() ? 0 : &offsets[0], ci.empty() ? 0 : &ci[0], dots);
+    }
+    template<typename T1, typename T2>
+    void draw_polys(size_t n, const T1* p1, const T2* p2,
+		    size_t npoly, const size_t* offsets, const int* ci, bool dots = true) const
+    {
+      auto_float x(n, p1, xdata_);
+      auto_float y(n, p2, ydata_);
+      polys(n, x.data, y.data, npoly, offsets, ci, dots);
+    }
+
+    template<typename T1, typename T2>
+    void draw_points(const T1& v1, const T2& v2, int symbol) const
+    {
+      stream(v1.size(), false, detail::data_of(v1), xdata_, detail::data_of(v2), ydata_,
+	     points_drawer(symbol));
     }
     template<typename T1, typename T2>
     void draw_points(size_t n, const T1* p1, const T2* p2, int symbol) const
     {
-      auto_float x(n, p1);
-      auto_float y(n, p2);
-      select();
-      cpgpt(n, x.data, y.data, symbol);
+      stream(n, false, p1, xdata_, p2, ydata_, points_drawer(symbol));
+    }
+
+    // log10 applied to the axes flagged by log (axis::xlog, ylog or log)
+    template<typename T1, typename T2>
+    void draw_points(const T1& v1, const T2& v2, int symbol, axis::value log) const
+    {
+      stream(v1.size(), false, detail::data_of(v1), x_transform(log),
+	     detail::data_of(v2), y_transform(log), points_drawer(symbol));
+    }
+    template<typename T1, typename T2>
+    void draw_points(size_t n, const T1* p1, const T2* p2, int symbol, axis::value log) const
+    {
+      stream(n, false, p1, x_transform(log), p2, y_transform(log), points_drawer(symbol));
+    }
+
+    // lazily evaluated points, see pgplot::range() and pgplot::generate()
+    template<typename It1, typename It2>
+    void draw_points(iter_source<It1, It2> src, int symbol) const
+    {
+      stream_source(src, false, points_drawer(symbol));
+    }
+    template<typename F>
+    void draw_points(generator<F> src, int symbol) const
+    {
+      stream_source(src, false, points_drawer(symbol));
     }
 
     void draw_marker(float x, float y, int symbol) const throw()
@@ -523,6 +2056,74 @@ namespace pgplot {
       cpgpt1(x, y, symbol);
     }
 
+    //
+    // many primitives per call, under one selection and batch; positions
+    // go through the data transform like the other array calls, and with
+    // cull those wholly outside the window are skipped
+    //
+
+    template<typename T1, typename T2, typename T3>
+    void draw_circles(const T1& x, const T2& y, const T3& r, bool cull = false) const
+    {
+      auto_float fx(x, xdata_), fy(y, ydata_), fr(r, transform(0, xdata_.scale));
+      circles(fx.n, fx.data, fy.data, fr.data, cull);
+    }
+
+    template<typename T1, typename T2, typename T3>
+    void draw_circles(size_t n, const T1* x, const T2* y, const T3* r, bool cull = false) const
+    {
+      auto_float fx(n, x, xdata_), fy(n, y, ydata_), fr(n, r, transform(0, xdata_.scale));
+      circles(n, fx.data, fy.data, fr.data, cull);
+    }
+
+    template<typename T1, typename T2, typename T3, typename T4>
+    void draw_rectangles(const T1& x1, const T2& x2, const T3& y1, const T4& y2, bool cull = false) const
+    {
+      auto_float a(x1, xdata_), b(x2, xdata_), c(y1, ydata_), d(y2, ydata_);
+      rectangles(a.n, a.data, b.data, c.data, d.data, cull);
+    }
+
+    template<typename T1, typename T2, typename T3, typename T4>
+    void draw_rectangles(size_t n, const T1* x1, const T2* x2, const T3* y1, const T4* y2,
+			 bool cull = false) const
+    {
+      auto_float a(n, x1, xdata_), b(n, x2, xdata_), c(n, y1, ydata_), d(n, y2, ydata_);
+      rectangles(n, a.data, b.data, c.data, d.data, cull);
+    }
+
+    // arrows from (x1, y1) to (x2, y2)
+    template<typename T1, typename T2, typename T3, typename T4>
+    void draw_arrows(const T1& x1, const T2& y1, const T3& x2, const T4& y2, bool cull = false) const
+    {
+      auto_float a(x1, xdata_), b(y1, ydata_), c(x2, xdata_), d(y2, ydata_);
+      arrows(a.n, a.data, b.data, c.data, d.data, cull);
+    }
+
+    template<typename T1, typename T2, typename T3, typename T4>
+    void draw_arrows(size_t n, const T1* x1, const T2* y1, const T3* x2, const T4* y2,
+		     bool cull = false) const
+    {
+      auto_float a(n, x1, xdata_), b(n, y1, ydata_), c(n, x2, xdata_), d(n, y2, ydata_);
+      arrows(n, a.data, b.data, c.data, d.data, cull);
+    }
+
+    // a marker symbol per point (PGPNTS); with fewer symbols than
+    // points the last symbol is used for the rest
+    template<typename T1, typename T2>
+    void draw_markers(const T1& x, const T2& y, const std::vector<int>& symbols, bool cull = false) const
+    {
+      auto_float fx(x, xdata_), fy(y, ydata_);
+      markers(fx.n, fx.data, fy.data, symbols.empty() ? 0 : &symbols[0], symbols.size(), cull);
+    }
+
+    template<typename T1, typename T2>
+    void draw_markers(size_t n, const T1* x, const T2* y, const int* symbols, size_t ns,
+		      bool cull = false) const
+    {
+      auto_float fx(n, x, xdata_), fy(n, y, ydata_);
+      markers(n, fx.data, fy.data, symbols, ns, cull);
+    }
+
     void text(float x, float y, float angle, float just, const std::string& text)
       const throw()
     {
@@ -668,7 +2269,19 @@ namespace pgplot {
       return retval;
     }
 
-    // FIXME: PGQTXT()
+    // the corners of the box text(x, y, angle, just, text) covers, in
+    // world coordinates; cached as text_length()
+    void text_bbox(float x, float y, float angle, float just, const std::string& text,
+		   float xbox[4], float ybox[4]) const
+    {
+      select();
+      const float params[] = { -1, x, y, angle, just };
+      float* v;
+      if (!texts_.find(text_state(), text_key(text, params, 5), 8, v))
+	cpgqtxt(x, y, angle, just, text.c_str(), v, v+4);
+      std::copy(v, v+4, xbox);
+      std::copy(v+4, v+8, ybox);
+    }
 
     void get_viewport(unit::value units, float& x1, float& x2, float& y1, float& y2)
       const throw()
@@ -719,13 +2332,13 @@ namespace pgplot {
     { select(); cpgsci(index); }
 
     void set_color_range(int low, int high) const throw()
-    { select(); cpgscir(low,high); }
+    { select(); cpgscir(low,high); ctab_ = 0; }
 
     void set_clipping(bool state) const throw()
     { select(); cpgsclp(state); }
 
     void set_color_rep(int index, float r, float g, float b) const throw()
-    { select(); cpgscr(index,r,g,b); }
+    { select(); cpgscr(index,r,g,b); ctab_ = 0; }
 
     void scroll_window(float dx, float dy) const throw()
     { select(); cpgscrl(dx,dy); }
@@ -736,6 +2349,7 @@ namespace pgplot {
       select();
       int retval;
       cpgscrn(index, name.c_str(), &retval);
+      ctab_ = 0;
       return retval;
     }
 
@@ -744,7 +2358,7 @@ namespace pgplot {
 
     void set_color_rep_hls(int index, float h, float l, float s)
       const throw()
-    { select(); cpgshls(index, h, l, s); }
+    { select(); cpgshls(index, h, l, s); ctab_ = 0; }
 
     void set_hatch_style(float angle, float sep, float phase) const throw()
     { select(); cpgshs(angle, sep, phase); }
@@ -771,6 +2385,10 @@ namespace pgplot {
     void set_window(float x1, float x2, float y1, float y2) const throw()
     { select(); cpgswin(x1, x2, y1, y2); }
 
+    // set_window() with limits given in untransformed data coordinates
+    void set_data_window(double x1, double x2, double y1, double y2) const throw()
+    { set_window(xdata_(x1), xdata_(x2), ydata_(y1), ydata_(y2)); }
+
     void text_box(
 		  const std::string& xopt, float xtick, int nx,
 		  const std::string& yopt, float ytick, int ny
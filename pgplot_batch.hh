@@ -0,0 +1,181 @@
+#ifndef PGPLOT_BATCH_HH
+#define PGPLOT_BATCH_HH
+
+#include <vector>
+#include <algorithm>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  // what series_batch::draw() did
+  struct batch_stats {
+    size_t series;		// drawn
+    size_t changes;		// colour index, line style and width calls made
+    size_t saved;		// fewer than drawing in the order added (within each z) would
+  };
+
+  // many polylines with their own colour index, line style and width,
+  // drawn in an order that groups equal attributes so that each is set
+  // once per group rather than once per series, unless the order added
+  // already needs fewer changes.  Series are only moved among those of
+  // equal z: all of a lower z are drawn first.  The data is narrowed
+  // to float when it is added, through the batch's own data transform
+  // (see set_data_transform) so that e.g. MJD or UNIX times keep their
+  // resolution; the stored points are then world coordinates and are
+  // drawn with the device's data transform set aside.
+  //
+  //   series_batch b;
+  //   for (...)
+  //     b.add(n, t, x[k], 2 + k % 13, linestyle::line, 1);
+  //   batch_stats s = b.draw(dev);
+  class series_batch {
+  public:
+    template <typename T1, typename T2>
+    void add(const T1& x, const T2& y, int color_index,
+	     linestyle::value style = linestyle::line, int width = 1, int z = 0)
+    {
+      auto_float fx(x, xdata_), fy(y, ydata_);
+      push(std::min(fx.n, fy.n), fx.data, fy.data, color_index, style, width, z);
+    }
+
+    template <typename T1, typename T2>
+    void add(size_t n, const T1* x, const T2* y, int color_index,
+	     linestyle::value style = linestyle::line, int width = 1, int z = 0)
+    {
+      auto_float fx(n, x, xdata_), fy(n, y, ydata_);
+      push(n, fx.data, fy.data, color_index, style, width, z);
+    }
+
+    // offset/scale applied to the series added from now on, as
+    // device::set_data_transform does when drawing
+    void set_data_transform(const transform& x, const transform& y) throw()
+    {
+      xdata_ = x;
+      ydata_ = y;
+    }
+
+    void get_data_transform(transform& x, transform& y) const throw()
+    {
+      x = xdata_;
+      y = ydata_;
+    }
+
+    size_t size() const throw() { return series_.size(); }
+
+    void clear()
+    {
+      series_.clear();
+      xs_.clear();
+      ys_.clear();
+    }
+
+    // draw every series, leaving dev's attributes as they were
+    batch_stats draw(const device& dev) const
+    {
+      // as added, within each z level
+      std::vector<size_t> added(series_.size());
+      for (size_t i=0; i<added.size(); ++i)
+	added[i] = i;
+      std::stable_sort(added.begin(), added.end(), [this](size_t a, size_t b) {
+	  return series_[a].z < series_[b].z;
+	});
+
+      // each level sorted by attributes, where that needs fewer changes
+      std::vector<size_t> order(added);
+      for (size_t b=0; b<order.size(); ) {
+	size_t e = b+1;
+	while (e < order.size() && series_[order[e]].z == series_[order[b]].z)
+	  ++e;
+	std::vector<size_t> sorted(order.begin()+b, order.begin()+e);
+	std::stable_sort(sorted.begin(), sorted.end(), [this](size_t i, size_t j) {
+	    const series& s = series_[i];
+	    const series& t = series_[j];
+	    if (s.ci != t.ci)
+	      return s.ci < t.ci;
+	    if (s.style != t.style)
+	      return s.style < t.style;
+	    return s.width < t.width;
+	  });
+	const series* last = b ? &series_[order[b-1]] : 0;
+	if (cost(last, &sorted[0], sorted.size()) < cost(last, &order[b], e-b))
+	  std::copy(sorted.begin(), sorted.end(), order.begin()+b);
+	b = e;
+      }
+
+      // choosing level by level can still lose at the level boundaries
+      const size_t base = cost(0, added.empty() ? 0 : &added[0], added.size());
+      if (cost(0, order.empty() ? 0 : &order[0], order.size()) > base)
+	order = added;
+
+      batch_stats st = { series_.size(), 0, base };
+      const series* last = 0;
+      transform xt, yt;
+      dev.get_data_transform(xt, yt);
+      dev.set_data_transform(transform(), transform());
+      dev.select();
+      save();
+      begin_batch();
+      for (size_t i=0; i<order.size(); ++i) {
+	const series& s = series_[order[i]];
+	if (!last || s.ci != last->ci)
+	  dev.set_color_index(s.ci);
+	if (!last || s.style != last->style)
+	  dev.set_line_style(s.style);
+	if (!last || s.width != last->width)
+	  dev.set_line_width(s.width);
+	st.changes += changes(last, s);
+	last = &s;
+	if (s.n)
+	  dev.draw_lines(s.n, &xs_[s.start], &ys_[s.start]);
+      }
+      end_batch();
+      unsave();
+      dev.set_data_transform(xt, yt);
+      st.saved -= st.changes;
+      return st;
+    }
+
+  private:
+    struct series {
+      size_t start, n;
+      int ci;
+      linestyle::value style;
+      int width, z;
+    };
+
+    std::vector<series> series_;
+    // all the series' points, end to end
+    std::vector<float> xs_, ys_;
+    transform xdata_, ydata_;
+
+    void push(size_t n, const float* x, const float* y, int ci, linestyle::value style, int width, int z)
+    {
+      series s = { xs_.size(), n, ci, style, width, z };
+      series_.push_back(s);
+      xs_.insert(xs_.end(), x, x+n);
+      ys_.insert(ys_.end(), y, y+n);
+    }
+
+    // attribute calls needed to draw the n series idx[] after last
+    size_t cost(const series* last, const size_t* idx, size_t n) const
+    {
+      size_t c = 0;
+      for (size_t i=0; i<n; ++i) {
+	c += changes(last, series_[idx[i]]);
+	last = &series_[idx[i]];
+      }
+      return c;
+    }
+
+    // attribute calls needed to go from a to b
+    static size_t changes(const series* a, const series& b)
+    {
+      if (!a)
+	return 3;
+      return (a->ci != b.ci) + (a->style != b.style) + (a->width != b.width);
+    }
+  };
+
+}
+
+#endif // PGPLOT_BATCH_HH
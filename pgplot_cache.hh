@@ -0,0 +1,105 @@
+#ifndef PGPLOT_CACHE_HH
+#define PGPLOT_CACHE_HH
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include "pgplot.hh"
+#include "pgplot_record.hh"
+
+extern char** environ;
+
+namespace pgplot {
+
+  // renders recordings to files, keeping a copy of each output under a
+  // name derived from a hash of the recording (every call and all of its
+  // data), the device type and the PGPLOT_* environment, which affects
+  // the drivers' output.  A recording that was rendered before is copied
+  // from the cache instead of being drawn again.  Only the one file
+  // named is cached, so multi-page output from the one-file-per-page
+  // drivers is not.
+  //
+  //   render_cache cache("/var/cache/plots");
+  //   cache.render(fig, "hourly.png", "/PNG");
+  class render_cache {
+  public:
+    // dir must exist
+    explicit render_cache(const std::string& dir) : dir_(dir), hits_(0), misses_(0) { }
+
+    // write rec to file as device type (e.g. "/PNG"); true if the file
+    // came from the cache
+    bool render(const recording& rec, const std::string& file, const std::string& type)
+    {
+      const std::string cached = dir_ + "/" + key(rec, type);
+      if (copy(cached, file)) {
+	++hits_;
+	return true;
+      }
+      ++misses_;
+      {
+	device dev(file + type);
+	rec.play(dev);
+      }
+      // write under a temporary name so that a concurrent reader never
+      // sees a partial file
+      const std::string tmp = cached + ".tmp" + std::to_string(getpid());
+      if (copy(file, tmp))
+	std::rename(tmp.c_str(), cached.c_str());
+      else
+	std::remove(tmp.c_str());
+      return false;
+    }
+
+    size_t hits() const throw() { return hits_; }
+
+    size_t misses() const throw() { return misses_; }
+
+    void reset_stats() throw() { hits_ = misses_ = 0; }
+
+  private:
+    std::string dir_;
+    size_t hits_, misses_;
+
+    static std::string key(const recording& rec, const std::string& type)
+    {
+      std::string t = type.substr(type.rfind('/') + 1);
+      std::transform(t.begin(), t.end(), t.begin(), ::tolower);
+
+      std::uint64_t h = rec.hash();
+      h = detail::hash_bytes(t.data(), t.size(), h);
+      // in any order
+      std::uint64_t env = 0;
+      for (char** e = environ; *e; ++e)
+	if (std::strncmp(*e, "PGPLOT_", 7) == 0)
+	  env ^= detail::hash_bytes(*e, std::strlen(*e));
+      h = detail::hash_bytes(&env, sizeof env, h);
+
+      std::ostringstream s;
+      s << std::hex << std::setw(16) << std::setfill('0') << h << '.' << t;
+      return s.str();
+    }
+
+    // false if from cannot be read or to cannot be written
+    static bool copy(const std::string& from, const std::string& to)
+    {
+      std::ifstream in(from.c_str(), std::ios::binary);
+      if (!in)
+	return false;
+      std::ofstream out(to.c_str(), std::ios::binary);
+      if (!out)
+	return false;
+      out << in.rdbuf();
+      return bool(out);
+    }
+  };
+
+}
+
+#endif // PGPLOT_CACHE_HH
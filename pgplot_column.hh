@@ -0,0 +1,177 @@
+#ifndef PGPLOT_COLUMN_HH
+#define PGPLOT_COLUMN_HH
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  namespace column_type {
+    enum value { int8, uint8, int16, uint16, int32, uint32, int64, float32, float64 };
+  }
+
+  // exception thrown when a column file cannot be mapped
+  class column_error : public std::runtime_error {
+  public:
+    column_error(const std::string &m = "failed to map column") : std::runtime_error(m) { }
+  };
+
+  // one column of a flat binary file, memory-mapped rather than read:
+  // element i is at header + i*stride + offset.  A column can be passed
+  // wherever the array drawing calls take a container; native float32
+  // columns are handed to PGPLOT in place, other types are converted a
+  // chunk at a time.  Copies share the mapping.
+  class column {
+  public:
+    // stride 0 means the element size; swap reverses the byte order of
+    // each element, for data written on a machine of the other endianness
+    column(const std::string& path, column_type::value type,
+	   size_t header = 0, size_t stride = 0, size_t offset = 0, bool swap = false)
+      : type_(type), width_(width(type)), stride_(stride ? stride : width_),
+	swap_(swap && width_ > 1), n_(0), base_(0)
+    {
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+	throw column_error(std::string("failed to open column file '") + path + "'");
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+	close(fd);
+	throw column_error(std::string("failed to stat column file '") + path + "'");
+      }
+      const size_t len = st.st_size;
+      void* p = len ? mmap(0, len, PROT_READ, MAP_SHARED, fd, 0) : 0;
+      close(fd);
+      if (p == MAP_FAILED)
+	throw column_error(std::string("failed to map column file '") + path + "'");
+      map_ = std::shared_ptr<mapping>(new mapping(p, len));
+      if (p)
+	madvise(p, len, MADV_SEQUENTIAL);
+
+      if (len >= header + offset + width_)
+	n_ = (len - header - offset - width_) / stride_ + 1;
+      base_ = static_cast<const char*>(p) + header + offset;
+    }
+
+    size_t size() const throw() { return n_; }
+
+    column_type::value type() const throw() { return type_; }
+
+    double operator[](size_t i) const throw()
+    {
+      return get(base_ + i*stride_);
+    }
+
+    // the data itself, if it can be passed to PGPLOT without conversion
+    const float* direct(const transform& xf) const throw()
+    {
+      if (type_ != column_type::float32 || swap_ || stride_ != sizeof(float)
+	  || !xf.identity()
+	  || reinterpret_cast<std::uintptr_t>(base_) % alignof(float))
+	return 0;
+      return reinterpret_cast<const float*>(base_);
+    }
+
+    // convert elements [pos, pos+n) into out
+    void read(size_t pos, size_t n, float* out, const transform& xf) const throw()
+    {
+      const char* p = base_ + pos*stride_;
+      // start reading the next chunk in while this one is converted
+      const size_t page = sysconf(_SC_PAGESIZE);
+      const std::uintptr_t next = reinterpret_cast<std::uintptr_t>(p + n*stride_) & ~(page-1);
+      const std::uintptr_t end = reinterpret_cast<std::uintptr_t>(map_->addr) + map_->len;
+      if (next < end)
+	madvise(reinterpret_cast<void*>(next), std::min<size_t>(n*stride_, end-next), MADV_WILLNEED);
+
+      switch (type_) {
+      case column_type::int8: convert<std::int8_t>(p, n, out, xf); break;
+      case column_type::uint8: convert<std::uint8_t>(p, n, out, xf); break;
+      case column_type::int16: convert<std::int16_t>(p, n, out, xf); break;
+      case column_type::uint16: convert<std::uint16_t>(p, n, out, xf); break;
+      case column_type::int32: convert<std::int32_t>(p, n, out, xf); break;
+      case column_type::uint32: convert<std::uint32_t>(p, n, out, xf); break;
+      case column_type::int64: convert<std::int64_t>(p, n, out, xf); break;
+      case column_type::float32: convert<float>(p, n, out, xf); break;
+      case column_type::float64: convert<double>(p, n, out, xf); break;
+      }
+    }
+
+  private:
+    struct mapping {
+      void* addr;
+      size_t len;
+      mapping(void* addr_, size_t len_) : addr(addr_), len(len_) { }
+      ~mapping() { if (addr) munmap(addr, len); }
+    };
+
+    column_type::value type_;
+    size_t width_, stride_;
+    bool swap_;
+    size_t n_;
+    std::shared_ptr<mapping> map_;
+    const char* base_;
+
+    static size_t width(column_type::value type)
+    {
+      switch (type) {
+      case column_type::int8: case column_type::uint8: return 1;
+      case column_type::int16: case column_type::uint16: return 2;
+      case column_type::int32: case column_type::uint32: case column_type::float32: return 4;
+      default: return 8;
+      }
+    }
+
+    // element at p, which need not be aligned
+    template <typename T>
+    T load(const char* p) const throw()
+    {
+      char b[sizeof(T)];
+      std::memcpy(b, p, sizeof b);
+      if (swap_)
+	std::reverse(b, b + sizeof b);
+      T v;
+      std::memcpy(&v, b, sizeof v);
+      return v;
+    }
+
+    double get(const char* p) const throw()
+    {
+      switch (type_) {
+      case column_type::int8: return load<std::int8_t>(p);
+      case column_type::uint8: return load<std::uint8_t>(p);
+      case column_type::int16: return load<std::int16_t>(p);
+      case column_type::uint16: return load<std::uint16_t>(p);
+      case column_type::int32: return load<std::int32_t>(p);
+      case column_type::uint32: return load<std::uint32_t>(p);
+      case column_type::int64: return load<std::int64_t>(p);
+      case column_type::float32: return load<float>(p);
+      default: return load<double>(p);
+      }
+    }
+
+    template <typename T>
+    void convert(const char* p, size_t n, float* out, const transform& xf) const throw()
+    {
+      if (!swap_ && stride_ == sizeof(T) && reinterpret_cast<std::uintptr_t>(p) % alignof(T) == 0)
+	detail::narrow(reinterpret_cast<const T*>(p), n, out, xf);
+      else if (xf.identity())
+	for (size_t i=0; i<n; ++i, p+=stride_)
+	  out[i] = load<T>(p);
+      else
+	for (size_t i=0; i<n; ++i, p+=stride_)
+	  out[i] = xf(load<T>(p));
+    }
+  };
+
+}
+
+#endif // PGPLOT_COLUMN_HH
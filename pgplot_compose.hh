@@ -0,0 +1,68 @@
+#ifndef PGPLOT_COMPOSE_HH
+#define PGPLOT_COMPOSE_HH
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include "pgplot.hh"
+#include "pgplot_record.hh"
+
+namespace pgplot {
+
+  // draws one panel into a recording
+  typedef std::function<void(recording&)> panel_func;
+
+  // a subdivided page whose panels are prepared concurrently: each
+  // panel function records its calls on a thread of its own, so the data
+  // conversion and whatever the function computes run in parallel, and
+  // the recordings are then played on dev one after another in panel
+  // order.  A panel usually starts with env(), which moves to the next
+  // panel just as it does when drawing directly.  The functions must not
+  // use any device.  Needs -pthread on older toolchains.
+  //
+  //   std::vector<panel_func> panels;
+  //   for (int i=0; i<36; ++i)
+  //     panels.push_back([&, i](recording& r) { r.env(...); r.draw_lines(...); });
+  //   compose(dev, 6, 6, panels);
+  inline void compose(const device& dev, int nx, int ny,
+		      const std::vector<panel_func>& panels, size_t threads = 0)
+  {
+    std::vector<recording> recs(panels.size());
+    std::vector<std::exception_ptr> errors(panels.size());
+    std::atomic<size_t> next(0);
+
+    auto work = [&]() {
+      for (size_t i; (i = next++) < panels.size(); )
+	try {
+	  panels[i](recs[i]);
+	}
+	catch (...) {
+	  errors[i] = std::current_exception();
+	}
+    };
+
+    if (!threads)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, panels.size());
+    std::vector<std::thread> pool;
+    for (size_t t=1; t<threads; ++t)
+      pool.push_back(std::thread(work));
+    work();
+    for (size_t t=0; t<pool.size(); ++t)
+      pool[t].join();
+
+    for (size_t i=0; i<errors.size(); ++i)
+      if (errors[i])
+	std::rethrow_exception(errors[i]);
+
+    dev.subdivide(nx, ny);
+    for (size_t i=0; i<recs.size(); ++i)
+      recs[i].play(dev);
+  }
+
+}
+
+#endif // PGPLOT_COMPOSE_HH
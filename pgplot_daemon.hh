@@ -0,0 +1,373 @@
+#ifndef PGPLOT_DAEMON_HH
+#define PGPLOT_DAEMON_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "pgplot.hh"
+#include "pgplot_record.hh"
+#include "pgplot_pool.hh"
+
+namespace pgplot {
+
+  // a local plot server that keeps devices open between jobs, and the
+  // client for it.  A job is a recording and the device name to play it
+  // on; the recording travels in a sealed memfd passed with SCM_RIGHTS,
+  // which the server maps and plays in place, so the data is written
+  // once by the client and never copied through the socket.
+  //
+  //   plot_server("/tmp/pgplotd.sock").run();	// see pgplotd.cc
+  //
+  //   plot_client c;
+  //   recording fig;
+  //   fig.env(...);
+  //   c.render("quick.png/PNG", fig);
+
+  // $XDG_RUNTIME_DIR/pgplotd.sock, or a per-user name in /tmp
+  inline std::string default_socket_path()
+  {
+    const char* dir = std::getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir)
+      return std::string(dir) + "/pgplotd.sock";
+    return "/tmp/pgplotd-" + std::to_string(getuid()) + ".sock";
+  }
+
+  namespace detail {
+
+    // the longest device name a client may send
+    const size_t max_devname = 4096;
+
+    // seconds the server waits on a client that has started sending a
+    // job, or on reading its reply, before dropping it
+    const int client_timeout = 2;
+
+    // the seals that keep a job's memfd from changing while it is mapped
+    const int job_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+    inline sockaddr_un unix_address(const std::string& path)
+    {
+      sockaddr_un a;
+      std::memset(&a, 0, sizeof a);
+      a.sun_family = AF_UNIX;
+      if (path.size() >= sizeof a.sun_path)
+	throw std::runtime_error("socket path too long: " + path);
+      std::memcpy(a.sun_path, path.c_str(), path.size());
+      return a;
+    }
+
+    // a one-byte message carrying fd
+    inline bool send_fd(int sock, int fd) throw()
+    {
+      char byte = 'J';
+      iovec iov = { &byte, 1 };
+      char control[CMSG_SPACE(sizeof(int))];
+      std::memset(control, 0, sizeof control);
+      msghdr m;
+      std::memset(&m, 0, sizeof m);
+      m.msg_iov = &iov;
+      m.msg_iovlen = 1;
+      m.msg_control = control;
+      m.msg_controllen = sizeof control;
+      cmsghdr* c = CMSG_FIRSTHDR(&m);
+      c->cmsg_level = SOL_SOCKET;
+      c->cmsg_type = SCM_RIGHTS;
+      c->cmsg_len = CMSG_LEN(sizeof(int));
+      std::memcpy(CMSG_DATA(c), &fd, sizeof fd);
+      return sendmsg(sock, &m, MSG_NOSIGNAL) == 1;
+    }
+
+    // -1 if the peer has gone or sent no descriptor
+    inline int recv_fd(int sock) throw()
+    {
+      char byte;
+      iovec iov = { &byte, 1 };
+      char control[CMSG_SPACE(sizeof(int))];
+      msghdr m;
+      std::memset(&m, 0, sizeof m);
+      m.msg_iov = &iov;
+      m.msg_iovlen = 1;
+      m.msg_control = control;
+      m.msg_controllen = sizeof control;
+      ssize_t k;
+      while ((k = recvmsg(sock, &m, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+	;
+      if (k != 1)
+	return -1;
+      for (cmsghdr* c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c))
+	if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+	  int fd;
+	  std::memcpy(&fd, CMSG_DATA(c), sizeof fd);
+	  return fd;
+	}
+      return -1;
+    }
+  }
+
+  class plot_server {
+  public:
+    // listen on path, replacing a stale socket there but not a live one
+    // or anything else; at most max_idle devices of each type are kept
+    // open
+    explicit plot_server(const std::string& path = default_socket_path(), size_t max_idle = 2)
+      : path_(path), max_idle_(max_idle), running_(false)
+    {
+      const sockaddr_un a = detail::unix_address(path);
+      remove_stale(a);
+      listen_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (listen_ < 0)
+	throw std::runtime_error("failed to create socket");
+      if (bind(listen_, reinterpret_cast<const sockaddr*>(&a), sizeof a) != 0
+	  || listen(listen_, 16) != 0) {
+	close(listen_);
+	throw std::runtime_error("failed to listen on " + path);
+      }
+    }
+
+    ~plot_server()
+    {
+      for (size_t i=0; i<clients_.size(); ++i)
+	close(clients_[i]);
+      close(listen_);
+      unlink(path_.c_str());
+    }
+
+    // serve jobs one at a time, in the order they arrive, until stop()
+    void run()
+    {
+      running_ = true;
+      std::vector<pollfd> fds;
+      while (running_) {
+	fds.clear();
+	pollfd l = { listen_, POLLIN, 0 };
+	fds.push_back(l);
+	for (size_t i=0; i<clients_.size(); ++i) {
+	  pollfd p = { clients_[i], POLLIN, 0 };
+	  fds.push_back(p);
+	}
+	if (poll(&fds[0], fds.size(), -1) < 0) {
+	  if (errno == EINTR)
+	    continue;
+	  throw std::runtime_error("poll failed");
+	}
+	for (size_t i=fds.size(); i-- > 1; ) {
+	  bool keep = true;
+	  if (fds[i].revents) {
+	    // a client that breaks the protocol is dropped, not the server
+	    try {
+	      keep = serve(clients_[i-1]);
+	    }
+	    catch (const std::exception&) {
+	      keep = false;
+	    }
+	  }
+	  if (!keep) {
+	    close(clients_[i-1]);
+	    clients_.erase(clients_.begin() + (i-1));
+	  }
+	}
+	if (fds[0].revents & POLLIN) {
+	  const int c = accept4(listen_, 0, 0, SOCK_CLOEXEC);
+	  if (c >= 0) {
+	    // jobs are read on this thread: a client that stalls mid-job
+	    // times out rather than holding up the others
+	    const timeval tv = { detail::client_timeout, 0 };
+	    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+	    setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+	    clients_.push_back(c);
+	  }
+	}
+      }
+    }
+
+    // make run() return, e.g. from a signal handler
+    void stop() throw() { running_ = false; }
+
+  private:
+    std::string path_;
+    size_t max_idle_;
+    int listen_;
+    volatile std::sig_atomic_t running_;
+    std::vector<int> clients_;
+    // warm devices by device type
+    std::map<std::string, std::unique_ptr<device_pool> > pools_;
+
+    plot_server(const plot_server&);
+    plot_server& operator=(const plot_server&);
+
+    // unlink a socket at a's path left by a server that has gone
+    static void remove_stale(const sockaddr_un& a)
+    {
+      struct stat st;
+      if (lstat(a.sun_path, &st) != 0)
+	return;
+      if (!S_ISSOCK(st.st_mode))
+	throw std::runtime_error(std::string(a.sun_path) + " exists and is not a socket");
+      const int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (s < 0)
+	throw std::runtime_error("failed to create socket");
+      const bool live = connect(s, reinterpret_cast<const sockaddr*>(&a), sizeof a) == 0;
+      close(s);
+      if (live)
+	throw std::runtime_error(std::string("a plot server is already listening on ") + a.sun_path);
+      unlink(a.sun_path);
+    }
+
+    // one job from client c; false when the client has gone
+    bool serve(int c)
+    {
+      const int fd = detail::recv_fd(c);
+      std::string devname;
+      if (fd < 0)
+	return false;
+      if (!detail::recv_string(c, devname, detail::max_devname)) {
+	close(fd);
+	return false;
+      }
+
+      std::uint8_t ok = 1;
+      std::string message;
+      try {
+	play(fd, devname);
+      }
+      catch (const std::exception& e) {
+	ok = 0;
+	message = e.what();
+      }
+      close(fd);
+      return detail::send_all(c, &ok, sizeof ok) && detail::send_string(c, message);
+    }
+
+    void play(int fd, const std::string& devname)
+    {
+      // the client keeps the memfd: without the seals it could shrink it
+      // under the mapping while it plays
+      const int seals = fcntl(fd, F_GET_SEALS);
+      if (seals < 0 || (seals & detail::job_seals) != detail::job_seals)
+	throw std::runtime_error("recording is not sealed");
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+	throw std::runtime_error("cannot stat recording");
+      const size_t n = st.st_size;
+      void* p = n ? mmap(0, n, PROT_READ, MAP_PRIVATE, fd, 0) : 0;
+      if (p == MAP_FAILED)
+	throw std::runtime_error("cannot map recording");
+
+      // "file/TYPE", or just "/TYPE"
+      const std::string::size_type slash = devname.rfind('/');
+      const std::string type = slash == std::string::npos ? devname : devname.substr(slash);
+      const std::string file = slash == std::string::npos ? "" : devname.substr(0, slash);
+      std::unique_ptr<device_pool>& pool = pools_[type];
+      if (!pool)
+	pool.reset(new device_pool(type, max_idle_));
+      try {
+	device_pool::lease dev = pool->acquire(file);
+	recording::play(*dev, static_cast<const char*>(p), n);
+      }
+      catch (...) {
+	if (p)
+	  munmap(p, n);
+	throw;
+      }
+      if (p)
+	munmap(p, n);
+    }
+  };
+
+  class plot_client {
+  public:
+    explicit plot_client(const std::string& path = default_socket_path())
+    {
+      const sockaddr_un a = detail::unix_address(path);
+      sock_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (sock_ < 0 || connect(sock_, reinterpret_cast<const sockaddr*>(&a), sizeof a) != 0) {
+	if (sock_ >= 0)
+	  close(sock_);
+	throw open_error("failed to connect to plot server at " + path);
+      }
+    }
+
+    ~plot_client() { close(sock_); }
+
+    // play rec on the server's device devname and wait for it; false
+    // with the server's message if it failed.  A relative file name in
+    // devname is taken from this process's working directory, not the
+    // server's.
+    bool render(const std::string& devname, const recording& rec, std::string& message)
+    {
+      const std::string name = absolute(devname);
+      if (name.size() > detail::max_devname)
+	throw std::runtime_error("device name too long: " + name);
+      const int fd = memfd_create("pgplot-job", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+      if (fd < 0)
+	throw std::runtime_error("failed to create memory file for job");
+      const std::string& b = rec.bytes();
+      size_t done = 0;
+      while (done < b.size()) {
+	const ssize_t k = write(fd, b.data() + done, b.size() - done);
+	if (k <= 0) {
+	  close(fd);
+	  throw std::runtime_error("failed to write job");
+	}
+	done += k;
+      }
+      if (fcntl(fd, F_ADD_SEALS, detail::job_seals) != 0) {
+	close(fd);
+	throw std::runtime_error("failed to seal job");
+      }
+      const bool sent = detail::send_fd(sock_, fd) && detail::send_string(sock_, name);
+      close(fd);
+
+      std::uint8_t ok;
+      if (!sent || !detail::recv_all(sock_, &ok, sizeof ok) || !detail::recv_string(sock_, message))
+	throw std::runtime_error("lost connection to plot server");
+      return ok;
+    }
+
+    bool render(const std::string& devname, const recording& rec)
+    {
+      std::string message;
+      return render(devname, rec, message);
+    }
+
+  private:
+    int sock_;
+
+    plot_client(const plot_client&);
+    plot_client& operator=(const plot_client&);
+
+    // devname with a relative file part ("file/TYPE") made absolute
+    static std::string absolute(const std::string& devname)
+    {
+      const std::string::size_type slash = devname.rfind('/');
+      if (slash == std::string::npos || slash == 0 || devname[0] == '/')
+	return devname;
+      std::vector<char> cwd(256);
+      while (!getcwd(&cwd[0], cwd.size())) {
+	if (errno != ERANGE)
+	  throw std::runtime_error("cannot get working directory");
+	cwd.resize(cwd.size() * 2);
+      }
+      return std::string(&cwd[0]) + "/" + devname;
+    }
+  };
+
+}
+
+#endif // PGPLOT_DAEMON_HH
@@ -0,0 +1,209 @@
+#ifndef PGPLOT_FARM_HH
+#define PGPLOT_FARM_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <exception>
+#include <cstdint>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "pgplot.hh"
+#include "pgplot_record.hh"
+
+namespace pgplot {
+
+  // outcome of one render_farm job
+  struct farm_result {
+    bool ok;
+    std::string message;	// what went wrong, if not ok
+    farm_result() : ok(false) { }
+  };
+
+  // worker processes that play recordings on devices of their own.
+  // PGPLOT keeps global state and renders one figure at a time per
+  // process, so figures are spread over forked workers, each with its own
+  // PGPLOT; the recordings and results travel over socket pairs.  The
+  // workers are forked by the constructor, which is best done before the
+  // program starts other threads.
+  //
+  //   render_farm farm;
+  //   for (...) {
+  //     recording fig;
+  //     fig.env(...);
+  //     farm.submit("plot42.png/PNG", fig);
+  //   }
+  //   std::vector<farm_result> done = farm.run();
+  class render_farm {
+  public:
+    // workers 0 means one per online processor
+    explicit render_farm(size_t workers = 0)
+    {
+      if (!workers) {
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	workers = n > 0 ? n : 1;
+      }
+      for (size_t i=0; i<workers; ++i) {
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+	  break;
+	const pid_t pid = fork();
+	if (pid == 0) {
+	  close(sv[0]);
+	  for (size_t j=0; j<workers_.size(); ++j)
+	    close(workers_[j].fd);
+	  serve(sv[1]);
+	  _exit(0);
+	}
+	close(sv[1]);
+	if (pid < 0) {
+	  close(sv[0]);
+	  break;
+	}
+	workers_.push_back(worker(pid, sv[0]));
+      }
+      if (workers_.empty())
+	throw std::runtime_error("failed to start render farm workers");
+    }
+
+    ~render_farm()
+    {
+      for (size_t i=0; i<workers_.size(); ++i)
+	if (workers_[i].fd >= 0)
+	  close(workers_[i].fd);
+      for (size_t i=0; i<workers_.size(); ++i)
+	waitpid(workers_[i].pid, 0, 0);
+    }
+
+    size_t workers() const throw() { return workers_.size(); }
+
+    // queue rec to be played on a new device opened as devname; returns
+    // the job's index in the results of the next run()
+    size_t submit(const std::string& devname, const recording& rec)
+    {
+      queue_.push_back(job(devname, rec));
+      return queue_.size() - 1;
+    }
+
+    // render the queued jobs, each on whichever worker is free, and wait
+    // for all of them
+    std::vector<farm_result> run()
+    {
+      std::vector<farm_result> results(queue_.size());
+      size_t next = 0, outstanding = 0;
+
+      for (size_t i=0; i<workers_.size(); ++i)
+	dispatch(workers_[i], next, outstanding, results);
+
+      std::vector<pollfd> fds;
+      std::vector<size_t> which;
+      while (outstanding) {
+	fds.clear();
+	which.clear();
+	for (size_t i=0; i<workers_.size(); ++i)
+	  if (workers_[i].job != none) {
+	    pollfd p = { workers_[i].fd, POLLIN, 0 };
+	    fds.push_back(p);
+	    which.push_back(i);
+	  }
+	if (poll(&fds[0], fds.size(), -1) < 0) {
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+	for (size_t k=0; k<fds.size(); ++k) {
+	  if (!fds[k].revents)
+	    continue;
+	  worker& w = workers_[which[k]];
+	  farm_result& r = results[w.job];
+	  std::uint8_t ok;
+	  w.job = none;
+	  --outstanding;
+	  if (detail::recv_all(w.fd, &ok, sizeof ok) && detail::recv_string(w.fd, r.message))
+	    r.ok = ok;
+	  else {
+	    r.message = "render farm worker exited";
+	    retire(w);
+	  }
+	  dispatch(w, next, outstanding, results);
+	}
+      }
+
+      for (; next<queue_.size(); ++next)
+	results[next].message = "no render farm workers left";
+      queue_.clear();
+      return results;
+    }
+
+  private:
+    static const size_t none = size_t(-1);
+
+    struct worker {
+      pid_t pid;
+      int fd;
+      size_t job;		// running, or none
+      worker(pid_t pid_, int fd_) : pid(pid_), fd(fd_), job(none) { }
+    };
+
+    struct job {
+      std::string devname;
+      recording rec;
+      job(const std::string& devname_, const recording& rec_) : devname(devname_), rec(rec_) { }
+    };
+
+    std::vector<worker> workers_;
+    std::deque<job> queue_;
+
+    render_farm(const render_farm&);
+    render_farm& operator=(const render_farm&);
+
+    void retire(worker& w)
+    {
+      close(w.fd);
+      w.fd = -1;
+    }
+
+    // hand the next queued job to w if it is idle and alive
+    void dispatch(worker& w, size_t& next, size_t& outstanding, std::vector<farm_result>& results)
+    {
+      while (w.fd >= 0 && w.job == none && next < queue_.size()) {
+	const job& j = queue_[next];
+	if (detail::send_string(w.fd, j.devname) && j.rec.send(w.fd)) {
+	  w.job = next++;
+	  ++outstanding;
+	  return;
+	}
+	results[next++].message = "render farm worker exited";
+	retire(w);
+      }
+    }
+
+    // the worker side: play jobs until the parent goes away
+    static void serve(int fd)
+    {
+      std::string devname;
+      recording rec;
+      while (detail::recv_string(fd, devname) && rec.receive(fd)) {
+	std::uint8_t ok = 1;
+	std::string message;
+	try {
+	  device dev(devname);
+	  rec.play(dev);
+	}
+	catch (const std::exception& e) {
+	  ok = 0;
+	  message = e.what();
+	}
+	if (!detail::send_all(fd, &ok, sizeof ok) || !detail::send_string(fd, message))
+	  break;
+      }
+      close(fd);
+    }
+  };
+
+}
+
+#endif // PGPLOT_FARM_HH
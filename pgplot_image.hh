@@ -0,0 +1,137 @@
+#ifndef PGPLOT_IMAGE_HH
+#define PGPLOT_IMAGE_HH
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  // an image drawn as colour indices with device::draw_pixels, where the
+  // wrapper rather than PGPLOT applies the image transfer function and
+  // quantises.  The data is narrowed to float once; the transferred
+  // levels are kept while the data range and transfer function stay the
+  // same, and the colour indices while the colour index range does too,
+  // so changing only the index range requantises and an unchanged redraw
+  // does neither.  Both passes are plain loops over contiguous floats,
+  // left to the compiler to vectorise, split by rows over threads for
+  // large images (needs -pthread on older toolchains).
+  class index_image {
+  public:
+    // nx by ny values, x varying fastest
+    template <typename T>
+    index_image(size_t nx, size_t ny, const T* data)
+      : nx_(nx), ny_(ny), data_(nx*ny), itf_(-1), a1_(0), a2_(0), low_(0), high_(-1)
+    {
+      detail::narrow(data, data_.size(), data_.empty() ? 0 : &data_[0], transform());
+    }
+
+    template <typename T>
+    index_image(size_t nx, size_t ny, const std::vector<T>& data)
+      : nx_(nx), ny_(ny), data_(nx*ny), itf_(-1), a1_(0), a2_(0), low_(0), high_(-1)
+    {
+      detail::narrow(data.begin(), data_.size(), data_.empty() ? 0 : &data_[0], transform());
+    }
+
+    size_t nx() const throw() { return nx_; }
+
+    size_t ny() const throw() { return ny_; }
+
+    // colour indices low..high for data levels a1..a2 through itf, as
+    // PGIMAG maps them except that values outside a1..a2 are clamped
+    const std::vector<int>& indices(float a1, float a2, image_transfer::value itf,
+				    int low, int high) const
+    {
+      if (itf != itf_ || a1 != a1_ || a2 != a2_) {
+	level_.resize(data_.size());
+	parallel([&](size_t b, size_t e) { transfer(b, e, a1, a2, itf); });
+	itf_ = itf;
+	a1_ = a1;
+	a2_ = a2;
+	high_ = low_ - 1;
+      }
+      if (low != low_ || high != high_) {
+	ci_.resize(data_.size());
+	parallel([&](size_t b, size_t e) { quantise(b, e, low, high); });
+	low_ = low;
+	high_ = high;
+      }
+      return ci_;
+    }
+
+    // draw in the world rectangle x1..x2, y1..y2 with levels a1..a2,
+    // using dev's image transfer function and colour index range
+    void draw(const device& dev, float a1, float a2, float x1, float x2, float y1, float y2) const
+    {
+      int low, high;
+      dev.get_image_range(low, high);
+      const std::vector<int>& ci = indices(a1, a2, dev.get_image_transfer(), low, high);
+      dev.draw_pixels(ci, nx_, ny_, x1, x2, y1, y2);
+    }
+
+  private:
+    size_t nx_, ny_;
+    std::vector<float> data_;
+    mutable std::vector<float> level_;	// transferred, in [0,1]
+    mutable int itf_;
+    mutable float a1_, a2_;
+    mutable std::vector<int> ci_;
+    mutable int low_, high_;
+
+    void transfer(size_t b, size_t e, float a1, float a2, image_transfer::value itf) const
+    {
+      const float* d = &data_[0];
+      float* l = &level_[0];
+      const float scale = a2 != a1 ? 1 / (a2 - a1) : 0;
+      for (size_t i=b; i<e; ++i)
+	l[i] = std::min(1.0f, std::max(0.0f, (d[i] - a1) * scale));
+      if (itf == image_transfer::log) {
+	const float norm = 1 / std::log(65001.0f);
+	for (size_t i=b; i<e; ++i)
+	  l[i] = std::log(1 + 65000 * l[i]) * norm;
+      }
+      else if (itf == image_transfer::sqrt)
+	for (size_t i=b; i<e; ++i)
+	  l[i] = std::sqrt(l[i]);
+    }
+
+    void quantise(size_t b, size_t e, int low, int high) const
+    {
+      const float* l = &level_[0];
+      int* ci = &ci_[0];
+      const float span = high - low;
+      for (size_t i=b; i<e; ++i)
+	ci[i] = low + int(l[i] * span + 0.5f);
+    }
+
+    // f(begin, end) over the pixels, in row blocks on several threads
+    // when the image is large enough to repay starting them
+    template <typename F>
+    void parallel(F f) const
+    {
+      const size_t n = data_.size();
+      size_t threads = n >= (1 << 18) ? std::thread::hardware_concurrency() : 1;
+      threads = std::max<size_t>(1, std::min(threads, ny_));
+      if (threads == 1) {
+	if (n)
+	  f(0, n);
+	return;
+      }
+      std::vector<std::thread> pool;
+      const size_t rows = (ny_ + threads - 1) / threads;
+      for (size_t t=1; t<threads; ++t) {
+	const size_t b = std::min(ny_, t*rows) * nx_, e = std::min(ny_, (t+1)*rows) * nx_;
+	if (b < e)
+	  pool.push_back(std::thread(f, b, e));
+      }
+      f(0, std::min(ny_, rows) * nx_);
+      for (size_t t=0; t<pool.size(); ++t)
+	pool[t].join();
+    }
+  };
+
+}
+
+#endif // PGPLOT_IMAGE_HH
@@ -0,0 +1,144 @@
+#ifndef PGPLOT_LABEL_HH
+#define PGPLOT_LABEL_HH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  // text labels that are drawn only where they do not overlap one drawn
+  // before them: earlier labels win.  Each label's box is worked out in
+  // device pixels from its string's cached length (see
+  // device::text_length) and the character height, and checked against
+  // the boxes already placed near it through a spatial hash, so placing
+  // n labels takes O(n) expected time.  The survivors are drawn in one batch.
+  //
+  //   annotations notes;
+  //   for (...)
+  //     notes.add(x[i], y[i], 0, 0, names[i]);
+  //   notes.draw(dev);
+  class annotations {
+  public:
+    // pad pixels are kept clear around each label
+    explicit annotations(float pad = 2) : pad_(pad) { }
+
+    // a label as device::text(x, y, angle, just, text) would draw it
+    void add(float x, float y, float angle, float just, const std::string& text)
+    {
+      labels_.push_back(label{ x, y, angle, just, text });
+    }
+
+    size_t size() const throw() { return labels_.size(); }
+
+    void clear() { labels_.clear(); }
+
+    // draw the labels that fit with dev's current font, height, viewport
+    // and window, skipping any outside the viewport; returns how many
+    // were drawn
+    size_t draw(const device& dev) const
+    {
+      float vx1, vx2, vy1, vy2, wx1, wx2, wy1, wy2;
+      dev.get_viewport(unit::pixel, vx1, vx2, vy1, vy2);
+      dev.get_window_boundary(wx1, wx2, wy1, wy2);
+      const float sx = wx2 != wx1 ? (vx2 - vx1) / (wx2 - wx1) : 0;
+      const float sy = wy2 != wy1 ? (vy2 - vy1) / (wy2 - wy1) : 0;
+
+      std::vector<box> placed;
+      std::vector<size_t> keep;
+      std::unordered_map<std::uint64_t, std::vector<size_t> > grid;
+      float cell = 0;
+
+      // PGLEN's y length is the string's length in y units, not its
+      // height, so that is taken from the character height
+      float xch, height;
+      dev.get_char_height(unit::pixel, xch, height);
+
+      for (size_t i=0; i<labels_.size(); ++i) {
+	const label& l = labels_[i];
+	float len, ylen;
+	dev.text_length(unit::pixel, l.text, len, ylen);
+	const box b = bounds(vx1 + (l.x - wx1) * sx, vy1 + (l.y - wy1) * sy,
+			     l.angle, l.just, len, height);
+	// outside the viewport, or not finite
+	if (!(b.x2 >= vx1 && b.x1 <= vx2 && b.y2 >= vy1 && b.y1 <= vy2))
+	  continue;
+	// cells about the size of the first label
+	if (!cell)
+	  cell = std::max(8.0f, std::max(b.x2 - b.x1, b.y2 - b.y1));
+
+	const std::int64_t cx1 = std::floor(b.x1 / cell), cx2 = std::floor(b.x2 / cell);
+	const std::int64_t cy1 = std::floor(b.y1 / cell), cy2 = std::floor(b.y2 / cell);
+	bool clear = true;
+	for (std::int64_t cx=cx1; clear && cx<=cx2; ++cx)
+	  for (std::int64_t cy=cy1; clear && cy<=cy2; ++cy) {
+	    std::unordered_map<std::uint64_t, std::vector<size_t> >::const_iterator c = grid.find(key(cx, cy));
+	    if (c != grid.end())
+	      for (size_t k=0; clear && k<c->second.size(); ++k)
+		clear = !overlap(b, placed[c->second[k]]);
+	  }
+	if (!clear)
+	  continue;
+	for (std::int64_t cx=cx1; cx<=cx2; ++cx)
+	  for (std::int64_t cy=cy1; cy<=cy2; ++cy)
+	    grid[key(cx, cy)].push_back(placed.size());
+	placed.push_back(b);
+	keep.push_back(i);
+      }
+
+      dev.select();
+      begin_batch();
+      for (size_t k=0; k<keep.size(); ++k) {
+	const label& l = labels_[keep[k]];
+	dev.text(l.x, l.y, l.angle, l.just, l.text);
+      }
+      end_batch();
+      return keep.size();
+    }
+
+  private:
+    struct label {
+      float x, y, angle, just;
+      std::string text;
+    };
+
+    struct box {
+      float x1, x2, y1, y2;
+    };
+
+    float pad_;
+    std::vector<label> labels_;
+
+    // pixel box of a string len by height pixels anchored at (px, py),
+    // padded
+    box bounds(float px, float py, float angle, float just, float len, float height) const
+    {
+      const float a = angle * float(M_PI / 180);
+      const float ux = std::cos(a), uy = std::sin(a);	// along the baseline
+      const float vx = -uy, vy = ux;			// up
+      const float x0 = px - just * len * ux, y0 = py - just * len * uy;
+      const float xs[] = { x0, x0 + len*ux, x0 + vx*height, x0 + len*ux + vx*height };
+      const float ys[] = { y0, y0 + len*uy, y0 + vy*height, y0 + len*uy + vy*height };
+      box b = { *std::min_element(xs, xs+4) - pad_, *std::max_element(xs, xs+4) + pad_,
+		*std::min_element(ys, ys+4) - pad_, *std::max_element(ys, ys+4) + pad_ };
+      return b;
+    }
+
+    static bool overlap(const box& a, const box& b)
+    {
+      return a.x1 < b.x2 && b.x1 < a.x2 && a.y1 < b.y2 && b.y1 < a.y2;
+    }
+
+    static std::uint64_t key(std::int64_t cx, std::int64_t cy)
+    {
+      return (std::uint64_t(cx) << 32) ^ std::uint64_t(cy & 0xffffffff);
+    }
+  };
+
+}
+
+#endif // PGPLOT_LABEL_HH
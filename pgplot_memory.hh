@@ -0,0 +1,146 @@
+#ifndef PGPLOT_MEMORY_HH
+#define PGPLOT_MEMORY_HH
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pgplot.hh"
+#include "pgplot_pool.hh"
+
+namespace pgplot {
+
+  namespace detail {
+
+    // where a memory_device's driver writes: pages in a tmpfs directory
+    // for the one-file-per-page drivers, which name each page's file
+    // themselves, otherwise an anonymous memfd opened by its /proc path
+    class memory_target {
+    protected:
+      int fd_;
+      std::string dir_, prefix_;
+
+      explicit memory_target(const std::string& type) : fd_(-1)
+      {
+	static unsigned serial = 0;
+	if (per_page_driver(type)) {
+	  struct stat st;
+	  dir_ = stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode) ? "/dev/shm" : "/tmp";
+	  prefix_ = "pgmem-" + std::to_string(getpid()) + "-" + std::to_string(serial++) + "-";
+	}
+	else {
+	  fd_ = memfd_create("pgplot", MFD_CLOEXEC);
+	  if (fd_ < 0)
+	    throw open_error("failed to create memory file for device");
+	}
+      }
+
+      // the memfd or spool moves with the device; the moved-from target
+      // owns nothing
+      memory_target(memory_target&& other) throw()
+	: fd_(other.fd_), dir_(std::move(other.dir_)), prefix_(std::move(other.prefix_))
+      {
+	other.fd_ = -1;
+	other.prefix_.clear();
+      }
+
+      ~memory_target()
+      {
+	if (fd_ >= 0)
+	  ::close(fd_);
+	else if (!prefix_.empty())
+	  take_pages();
+      }
+
+      std::string file_name() const
+      {
+	return fd_ >= 0 ? "/proc/self/fd/" + std::to_string(fd_) : dir_ + "/" + prefix_ + "#";
+      }
+
+      // the contents of the memfd
+      std::string take_memfd() const
+      {
+	struct stat st;
+	std::string s;
+	if (fstat(fd_, &st) != 0)
+	  return s;
+	s.resize(st.st_size);
+	size_t got = 0;
+	while (got < s.size()) {
+	  const ssize_t k = pread(fd_, &s[got], s.size() - got, got);
+	  if (k <= 0)
+	    break;
+	  got += k;
+	}
+	s.resize(got);
+	return s;
+      }
+
+      // the finished page files, which are removed
+      std::vector<std::string> take_pages() const
+      {
+	const std::vector<std::string> names = spooled_pages(dir_, prefix_);
+	std::vector<std::string> pages;
+	for (size_t i=0; i<names.size(); ++i) {
+	  const std::string path = dir_ + "/" + names[i];
+	  const int fd = open(path.c_str(), O_RDONLY);
+	  if (fd < 0)
+	    continue;
+	  std::string s;
+	  char buf[65536];
+	  ssize_t k;
+	  while ((k = read(fd, buf, sizeof buf)) > 0)
+	    s.append(buf, k);
+	  ::close(fd);
+	  std::remove(path.c_str());
+	  pages.push_back(s);
+	}
+	return pages;
+      }
+    };
+  }
+
+  // a device whose output is kept in memory and handed back as bytes
+  // rather than left in a file.  For the one-file-per-page drivers (PNG,
+  // GIF, PPM, XWD) each take() ends the page and returns its image, and
+  // the device stays open for the next figure; for other types the
+  // output is only complete once the device is closed, so take() closes
+  // it.
+  //
+  //   memory_device dev("/PNG");
+  //   dev.env(...);
+  //   std::string png = dev.take();
+  //
+  // It can be moved but not assigned.
+  class memory_device : private detail::memory_target, public device {
+  public:
+    explicit memory_device(const std::string& type = "/PNG")
+      : detail::memory_target(type), device(file_name() + type) { }
+
+    // the output; for per-page drivers the image of the page this ends,
+    // with any earlier pages not yet taken dropped
+    std::string take()
+    {
+      const std::vector<std::string> p = take_pages();
+      return p.empty() ? std::string() : p.back();
+    }
+
+    // every page finished since the last take, in order
+    std::vector<std::string> take_pages()
+    {
+      if (fd_ >= 0) {
+	close();
+	return std::vector<std::string>(1, take_memfd());
+      }
+      page();
+      return memory_target::take_pages();
+    }
+  };
+
+}
+
+#endif // PGPLOT_MEMORY_HH
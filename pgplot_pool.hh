@@ -0,0 +1,226 @@
+#ifndef PGPLOT_POOL_HH
+#define PGPLOT_POOL_HH
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <dirent.h>
+#include <unistd.h>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  namespace detail {
+
+    // whether PGPLOT device type writes a file per page, replacing any
+    // '#' in the file name with the page number
+    inline bool per_page_driver(const std::string& type)
+    {
+      std::string t = type.substr(type.rfind('/') + 1);
+      std::transform(t.begin(), t.end(), t.begin(), ::toupper);
+      static const char* drivers[] = { "PNG", "TPNG", "GIF", "VGIF", "PPM", "VPPM", "WD", "VWD" };
+      for (size_t i=0; i<sizeof drivers/sizeof drivers[0]; ++i)
+	if (t == drivers[i])
+	  return true;
+      return false;
+    }
+
+    // the files in dir whose names start with prefix, in page order
+    inline std::vector<std::string> spooled_pages(const std::string& dir, const std::string& prefix)
+    {
+      std::vector<std::string> pages;
+      if (DIR* d = opendir(dir.c_str())) {
+	while (dirent* e = readdir(d))
+	  if (std::string(e->d_name).compare(0, prefix.size(), prefix) == 0)
+	    pages.push_back(e->d_name);
+	closedir(d);
+      }
+      // page 10 after page 9
+      std::sort(pages.begin(), pages.end(),
+		[](const std::string& a, const std::string& b)
+		{ return a.size() != b.size() ? a.size() < b.size() : a < b; });
+      return pages;
+    }
+  }
+
+  // opened devices of one type kept for reuse, so that a program writing
+  // many figures does not pay for cpgopen/cpgclos per figure.  Each lease
+  // hands out a device with its attributes saved and names the file its
+  // output goes to.
+  //
+  // A PGPLOT file name is fixed when the device is opened, so output can
+  // only be redirected for the drivers that write one file per page
+  // (PNG, GIF, PPM, XWD and their variants): those devices write to
+  // spool files that are renamed when the lease ends.  Other file types
+  // are opened and closed per lease as before.  Leases must not outlive
+  // their pool.
+  //
+  //   device_pool pool("/PNG");
+  //   {
+  //     device_pool::lease fig = pool.acquire("fig1.png");
+  //     fig->env(...);
+  //   }				// fig1.png complete here
+  class device_pool {
+  public:
+    class lease;
+
+    // type is the PGPLOT device type, e.g. "/PNG"; at most max_idle
+    // devices are kept open between leases, and spool files go in dir
+    explicit device_pool(const std::string& type, size_t max_idle = 4,
+			 const std::string& dir = "/tmp")
+      : type_(type), dir_(dir), max_idle_(max_idle),
+	per_page_(detail::per_page_driver(type)) { }
+
+    // a device whose output will end up in file, or on the device
+    // itself for interactive types (file empty)
+    lease acquire(const std::string& file = "");
+
+    // devices currently held open
+    size_t idle() const throw() { return idle_.size(); }
+
+    // close the idle devices
+    void clear() { idle_.clear(); }
+
+    ~device_pool() { clear(); }
+
+  private:
+    // a device and the prefix of its spool files ("" for none)
+    struct slot {
+      device dev;
+      std::string spool;
+      slot(device&& dev_, const std::string& spool_) : dev(std::move(dev_)), spool(spool_) { }
+    };
+
+    std::string type_, dir_;
+    size_t max_idle_;
+    bool per_page_;
+    std::vector<slot> idle_;
+
+    device_pool(const device_pool&);
+    device_pool& operator=(const device_pool&);
+
+    void release(slot& s, const std::string& file);
+
+    // rename the finished pages spooled under prefix to file, file_2, ...
+    static void collect(const std::string& dir, const std::string& prefix,
+			const std::string& file);
+  };
+
+  class device_pool::lease {
+  public:
+    lease(lease&& other)
+      : pool_(other.pool_), slot_(std::move(other.slot_)), file_(std::move(other.file_))
+    {
+      other.pool_ = 0;
+    }
+
+    ~lease() { release(); }
+
+    const device& operator*() const throw() { return slot_.dev; }
+    const device* operator->() const throw() { return &slot_.dev; }
+
+    // finish the output now rather than at destruction
+    void release()
+    {
+      if (pool_) {
+	device_pool* p = pool_;
+	pool_ = 0;
+	p->release(slot_, file_);
+      }
+    }
+
+  private:
+    friend class device_pool;
+    device_pool* pool_;
+    slot slot_;
+    std::string file_;
+
+    lease(device_pool* pool, slot&& s, const std::string& file)
+      : pool_(pool), slot_(std::move(s)), file_(file) { }
+    lease(const lease&);
+    lease& operator=(const lease&);
+  };
+
+  inline device_pool::lease device_pool::acquire(const std::string& file)
+  {
+    if (!per_page_ && !file.empty())
+      return lease(this, slot(device(file + type_), ""), file);
+
+    if (idle_.empty()) {
+      std::string spool;
+      std::string name = type_;
+      if (per_page_) {
+	// '#' is replaced by the page number in the file name; the serial
+	// is shared by all pools, which may spool to the same directory
+	static unsigned serial = 0;
+	spool = "pgpool-" + std::to_string(getpid()) + "-" + std::to_string(serial++) + "-";
+	name = dir_ + "/" + spool + "#" + type_;
+      }
+      device dev(name);
+      dev.ask(false);
+      idle_.push_back(slot(std::move(dev), spool));
+    }
+    slot s(std::move(idle_.back()));
+    idle_.pop_back();
+    s.dev.select();
+    save();
+    return lease(this, std::move(s), file);
+  }
+
+  inline void device_pool::release(slot& s, const std::string& file)
+  {
+    if (s.spool.empty() && !file.empty())
+      return;			// opened for this lease, closed with it
+
+    s.dev.select();
+    unsave();
+    s.dev.set_data_transform(transform(), transform());
+    s.dev.set_simplify(0);
+    s.dev.set_line_gap(0);
+    s.dev.set_pick_index(false);
+    if (!s.spool.empty()) {
+      // ending the page makes the driver write its file
+      s.dev.page();
+      collect(dir_, s.spool, file);
+    }
+    if (idle_.size() < max_idle_)
+      idle_.push_back(std::move(s));
+  }
+
+  inline void device_pool::collect(const std::string& dir, const std::string& prefix,
+				   const std::string& file)
+  {
+    const std::vector<std::string> pages = detail::spooled_pages(dir, prefix);
+
+    const std::string::size_type dot = file.rfind('.');
+    const std::string::size_type slash = file.rfind('/');
+    const bool ext = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    for (size_t i=0; i<pages.size(); ++i) {
+      const std::string from = dir + "/" + pages[i];
+      if (file.empty()) {
+	std::remove(from.c_str());
+	continue;
+      }
+      std::string to = file;
+      if (i)
+	to = ext ? file.substr(0, dot) + "_" + std::to_string(i+1) + file.substr(dot)
+	  : file + "_" + std::to_string(i+1);
+      if (std::rename(from.c_str(), to.c_str()) != 0) {
+	// another file system
+	{
+	  std::ifstream in(from.c_str(), std::ios::binary);
+	  std::ofstream out(to.c_str(), std::ios::binary);
+	  out << in.rdbuf();
+	}
+	std::remove(from.c_str());
+      }
+    }
+  }
+
+}
+
+#endif // PGPLOT_POOL_HH
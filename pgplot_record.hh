@@ -0,0 +1,592 @@
+#ifndef PGPLOT_RECORD_HH
+#define PGPLOT_RECORD_HH
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  // exception thrown when a recording cannot be decoded
+  class record_error : public std::runtime_error {
+  public:
+    record_error(const std::string &m = "malformed recording") : std::runtime_error(m) { }
+  };
+
+  namespace detail {
+
+    // whole-buffer transfers on a socket; false if the peer has gone
+    inline bool send_all(int fd, const void* p, size_t n) throw()
+    {
+      const char* c = static_cast<const char*>(p);
+      while (n) {
+	const ssize_t k = ::send(fd, c, n, MSG_NOSIGNAL);
+	if (k < 0 && errno == EINTR)
+	  continue;
+	if (k <= 0)
+	  return false;
+	c += k;
+	n -= k;
+      }
+      return true;
+    }
+
+    inline bool recv_all(int fd, void* p, size_t n) throw()
+    {
+      char* c = static_cast<char*>(p);
+      while (n) {
+	const ssize_t k = ::recv(fd, c, n, 0);
+	if (k < 0 && errno == EINTR)
+	  continue;
+	if (k <= 0)
+	  return false;
+	c += k;
+	n -= k;
+      }
+      return true;
+    }
+
+    // a length-prefixed string
+    inline bool send_string(int fd, const std::string& s) throw()
+    {
+      const std::uint64_t n = s.size();
+      return send_all(fd, &n, sizeof n) && send_all(fd, s.data(), s.size());
+    }
+
+    // false also when the peer announces more than max bytes
+    inline bool recv_string(int fd, std::string& s, std::uint64_t max = std::uint64_t(-1))
+    {
+      std::uint64_t n;
+      if (!recv_all(fd, &n, sizeof n) || n > max || n > s.max_size())
+	return false;
+      s.resize(n);
+      return n == 0 || recv_all(fd, &s[0], n);
+    }
+  }
+
+  // a sequence of drawing calls kept as a flat byte string rather than
+  // sent to PGPLOT, so that a figure can be built without a device (or on
+  // another thread) and replayed later, or passed to another process.
+  // The methods take the arguments of the device methods of the same
+  // names; data arrays are converted to float when they are recorded,
+  // through the recording's own data transform (see set_data_transform)
+  // so that e.g. MJD or UNIX times keep their resolution.  The recorded
+  // arrays are then world coordinates: they are replayed with the
+  // device's data transform set aside.
+  class recording {
+  public:
+    recording() { }
+
+    // a recording received as bytes(); checked when it is played
+    explicit recording(const std::string& bytes) : buf_(bytes) { }
+
+    const std::string& bytes() const throw() { return buf_; }
+
+    size_t size() const throw() { return buf_.size(); }
+
+    bool empty() const throw() { return buf_.empty(); }
+
+    void clear() throw() { buf_.clear(); }
+
+    // identifies the calls and all their data
+    std::uint64_t hash() const throw() { return detail::hash_bytes(buf_.data(), buf_.size()); }
+
+    // append the calls of another recording
+    void append(const recording& r)
+    {
+      pad();
+      buf_ += r.buf_;
+    }
+
+    // pass the recording over a socket to receive() in another process
+    bool send(int fd) const throw() { return detail::send_string(fd, buf_); }
+
+    bool receive(int fd) { return detail::recv_string(fd, buf_); }
+
+    // issue the recorded calls on dev
+    void play(const device& dev) const { play(dev, buf_.data(), buf_.size()); }
+
+    // play n bytes of a recording held elsewhere, e.g. mapped from a
+    // file; arrays are used in place when bytes is 4-byte aligned
+    static void play(const device& dev, const char* bytes, size_t n);
+
+    // offset/scale applied to the data arrays recorded from now on, as
+    // device::set_data_transform does when drawing
+    void set_data_transform(const transform& x, const transform& y) throw()
+    {
+      xdata_ = x;
+      ydata_ = y;
+    }
+
+    void get_data_transform(transform& x, transform& y) const throw()
+    {
+      x = xdata_;
+      y = ydata_;
+    }
+
+    void env(float xmin, float xmax, float ymin, float ymax, bool just, axis::value axis)
+    { put(op::env); put(xmin); put(xmax); put(ymin); put(ymax); put<std::int32_t>(just); put<std::int32_t>(axis); }
+
+    // annotated with the recording's data transform, as device::label
+    // would with the device's, since that is set aside at replay
+    void label(const std::string& xlabel, const std::string& ylabel, const std::string& toplabel)
+    { put(op::label); put(xdata_.label(xlabel)); put(ydata_.label(ylabel)); put(toplabel); }
+
+    void box(const std::string& xopt, float xtick, int xsub,
+	     const std::string& yopt, float ytick, int ysub)
+    { put(op::box); put(xopt); put(xtick); put<std::int32_t>(xsub); put(yopt); put(ytick); put<std::int32_t>(ysub); }
+
+    void set_viewport(float xl, float xr, float yb, float yt)
+    { put(op::viewport); put(xl); put(xr); put(yb); put(yt); }
+
+    void set_standard_viewport() { put(op::standard_viewport); }
+
+    void set_window(float x1, float x2, float y1, float y2)
+    { put(op::window); put(x1); put(x2); put(y1); put(y2); }
+
+    void window_adjust(float x1, float x2, float y1, float y2)
+    { put(op::window_adjust); put(x1); put(x2); put(y1); put(y2); }
+
+    void page() { put(op::page); }
+
+    void panel(int x, int y) { put(op::panel); put<std::int32_t>(x); put<std::int32_t>(y); }
+
+    void subdivide(int nx, int ny) { put(op::subdivide); put<std::int32_t>(nx); put<std::int32_t>(ny); }
+
+    void save() { put(op::save); }
+
+    void unsave() { put(op::unsave); }
+
+    void begin_batch() { put(op::begin_batch); }
+
+    void end_batch() { put(op::end_batch); }
+
+    void set_color_index(int index) { put(op::color_index); put<std::int32_t>(index); }
+
+    void set_color_rep(int index, float r, float g, float b)
+    { put(op::color_rep); put<std::int32_t>(index); put(r); put(g); put(b); }
+
+    void set_line_width(int width) { put(op::line_width); put<std::int32_t>(width); }
+
+    void set_line_style(linestyle::value style) { put(op::line_style); put<std::int32_t>(style); }
+
+    void set_char_height(float size) { put(op::char_height); put(size); }
+
+    void set_char_font(font::value f) { put(op::char_font); put<std::int32_t>(f); }
+
+    void set_fill_style(fillstyle::value style) { put(op::fill_style); put<std::int32_t>(style); }
+
+    void set_clipping(bool state) { put(op::clipping); put<std::int32_t>(state); }
+
+    void move_pen(float x, float y) { put(op::move); put(x); put(y); }
+
+    void draw_line(float x, float y) { put(op::draw); put(x); put(y); }
+
+    void draw_rectangle(float x1, float x2, float y1, float y2)
+    { put(op::rectangle); put(x1); put(x2); put(y1); put(y2); }
+
+    void draw_circle(float x, float y, float r) { put(op::circle); put(x); put(y); put(r); }
+
+    void draw_arrow(float x1, float y1, float x2, float y2)
+    { put(op::arrow); put(x1); put(y1); put(x2); put(y2); }
+
+    void draw_marker(float x, float y, int symbol)
+    { put(op::marker); put(x); put(y); put<std::int32_t>(symbol); }
+
+    void text(float x, float y, const std::string& text)
+    { put(op::text); put(x); put(y); put(text); }
+
+    void text(float x, float y, float angle, float just, const std::string& text)
+    { put(op::text_angle); put(x); put(y); put(angle); put(just); put(text); }
+
+    void text(const std::string& side, float disp, float coord, float just, const std::string& text)
+    { put(op::text_side); put(side); put(disp); put(coord); put(just); put(text); }
+
+    template<typename T1, typename T2>
+    void draw_lines(const T1& v1, const T2& v2)
+    { auto_float x(v1, xdata_), y(v2, ydata_); put(op::lines); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void draw_lines(size_t n, const T1* p1, const T2* p2)
+    { auto_float x(n, p1, xdata_), y(n, p2, ydata_); put(op::lines); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void draw_points(const T1& v1, const T2& v2, int symbol)
+    { auto_float x(v1, xdata_), y(v2, ydata_); put(op::points); put<std::int32_t>(symbol); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void draw_points(size_t n, const T1* p1, const T2* p2, int symbol)
+    { auto_float x(n, p1, xdata_), y(n, p2, ydata_); put(op::points); put<std::int32_t>(symbol); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void draw_poly(const T1& v1, const T2& v2)
+    { auto_float x(v1, xdata_), y(v2, ydata_); put(op::poly); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void draw_poly(size_t n, const T1* p1, const T2* p2)
+    { auto_float x(n, p1, xdata_), y(n, p2, ydata_); put(op::poly); put(x); put(y); }
+
+    template<typename T1, typename T2, typename T3>
+    void errbar(err::value dir, const T1& v1, const T2& v2, const T3& v3, float t)
+    { errbar_(dir, v1.size(), detail::data_of(v1), detail::data_of(v2), detail::data_of(v3), t); }
+
+    template<typename T1, typename T2, typename T3>
+    void errbar(err::value dir, size_t n, const T1* p1, const T2* p2, const T3* p3, float t)
+    { errbar_(dir, n, p1, p2, p3, t); }
+
+    template<typename T1, typename T2>
+    void hist(const T1& v1, const T2& v2, bool center)
+    { auto_float x(v1, xdata_), y(v2); put(op::bin); put<std::int32_t>(center); put(x); put(y); }
+
+    template<typename T1, typename T2>
+    void hist(size_t n, const T1* p1, const T2* p2, bool center)
+    { auto_float x(n, p1, xdata_), y(n, p2); put(op::bin); put<std::int32_t>(center); put(x); put(y); }
+
+    template<typename T1>
+    void hist(const T1& v1, float min, float max, int nbin, int flag)
+    { auto_float d(v1, xdata_); put(op::hist); put(min); put(max); put<std::int32_t>(nbin); put<std::int32_t>(flag); put(d); }
+
+    template<typename T1>
+    void hist(size_t n, const T1* p1, float min, float max, int nbin, int flag)
+    { auto_float d(n, p1, xdata_); put(op::hist); put(min); put(max); put<std::int32_t>(nbin); put<std::int32_t>(flag); put(d); }
+
+  private:
+    struct op {
+      enum value : std::uint8_t {
+	nop, env, label, box, viewport, standard_viewport, window, window_adjust,
+	page, panel, subdivide, save, unsave, begin_batch, end_batch,
+	color_index, color_rep, line_width, line_style, char_height, char_font,
+	fill_style, clipping, move, draw, rectangle, circle, arrow, marker,
+	text, text_angle, text_side, lines, points, poly, errbar, bin, hist,
+	errbarx, errbary
+      };
+    };
+
+    std::string buf_;
+    transform xdata_, ydata_;
+
+    // as device::errbar: the bars' lengths, or for two-sided bars along a
+    // log axis their ends, worked out in world coordinates
+    template<typename S1, typename S2, typename S3>
+    void errbar_(err::value dir, size_t n, const S1& x, const S2& y, const S3& e, float t)
+    {
+      const bool along_x = dir == err::plusx || dir == err::minusx || dir == err::x;
+      const bool both = dir == err::x || dir == err::y;
+      const transform& bf = along_x ? xdata_ : ydata_;
+      std::vector<float> fx, fy, a, b;
+      for (size_t i=0; i<n; ++i) {
+	const double v = along_x ? x[i] : y[i];
+	const double ev = e[i];
+	float c, l;
+	if (!bf.log) {
+	  c = bf(v);
+	  l = ev * bf.scale;
+	}
+	else if (both) {
+	  c = bf(v - ev);
+	  l = bf(v + ev);
+	}
+	else {
+	  c = bf(v);
+	  l = dir == err::plusx || dir == err::plusy ? bf(v + ev) - c : c - bf(v - ev);
+	}
+	const float o = along_x ? ydata_(y[i]) : xdata_(x[i]);
+	if (bf.log && !(std::isfinite(o) && std::isfinite(c) && std::isfinite(l)))
+	  continue;
+	(along_x ? fy : fx).push_back(o);
+	(along_x ? fx : fy).push_back(c);
+	a.push_back(l);
+      }
+      const auto_float ax(fx), ay(fy), ae(a);
+      if (!bf.log || !both) {
+	put(op::errbar);
+	put<std::int32_t>(dir);
+	put(t);
+	put(ax);
+	put(ay);
+	put(ae);
+      }
+      else if (along_x) {
+	// lower ends in x, upper in the error array
+	put(op::errbarx);
+	put(t);
+	put(ax);
+	put(ae);
+	put(ay);
+      }
+      else {
+	put(op::errbary);
+	put(t);
+	put(ax);
+	put(ay);
+	put(ae);
+      }
+    }
+
+    template <typename T>
+    void put(const T& v)
+    {
+      buf_.append(reinterpret_cast<const char*>(&v), sizeof v);
+    }
+
+    void put(const std::string& s)
+    {
+      put<std::uint32_t>(s.size());
+      buf_ += s;
+    }
+
+    // arrays start at a multiple of 4 bytes so that they can be played
+    // from the buffer without a copy; nop bytes keep appended recordings
+    // aligned the same way
+    void pad() { buf_.append((4 - buf_.size() % 4) % 4, char(op::nop)); }
+
+    void put(const auto_float& a)
+    {
+      put<std::uint64_t>(a.n);
+      pad();
+      buf_.append(reinterpret_cast<const char*>(a.data), a.n * sizeof(float));
+    }
+
+    // decoding side
+    class reader {
+    public:
+      reader(const char* p, size_t n) : begin_(p), p_(p), end_(p + n) { }
+
+      bool done() const throw() { return p_ == end_; }
+
+      template <typename T>
+      T get()
+      {
+	need(sizeof(T));
+	T v;
+	std::memcpy(&v, p_, sizeof v);
+	p_ += sizeof v;
+	return v;
+      }
+
+      std::string str()
+      {
+	const std::uint32_t n = get<std::uint32_t>();
+	need(n);
+	std::string s(p_, n);
+	p_ += n;
+	return s;
+      }
+
+      const float* floats(std::uint64_t& n)
+      {
+	n = get<std::uint64_t>();
+	const size_t pad = (4 - (p_ - begin_) % 4) % 4;
+	need(pad);
+	p_ += pad;
+	if (n > size_t(end_ - p_) / sizeof(float))
+	  throw record_error("truncated recording");
+	const float* f = reinterpret_cast<const float*>(p_);
+	p_ += n * sizeof(float);
+	return f;
+      }
+
+      // n floats, which must match the count of an earlier array
+      const float* floats(std::uint64_t n, const char* what)
+      {
+	std::uint64_t m;
+	const float* f = floats(m);
+	if (m != n)
+	  throw record_error(std::string("mismatched ") + what + " array in recording");
+	return f;
+      }
+
+    private:
+      const char* begin_;
+      const char* p_;
+      const char* end_;
+
+      void need(size_t n)
+      {
+	if (n > size_t(end_ - p_))
+	  throw record_error("truncated recording");
+      }
+    };
+  };
+
+  inline void recording::play(const device& dev, const char* bytes, size_t n)
+  {
+    if (reinterpret_cast<std::uintptr_t>(bytes) % alignof(float)) {
+      const std::string copy(bytes, n);
+      play(dev, copy.data(), n);
+      return;
+    }
+    // the arrays are already world coordinates
+    struct world_guard {
+      const device& dev;
+      transform x, y;
+      explicit world_guard(const device& d) : dev(d)
+      {
+	dev.get_data_transform(x, y);
+	dev.set_data_transform(transform(), transform());
+      }
+      ~world_guard() { dev.set_data_transform(x, y); }
+    } guard(dev);
+
+    typedef std::int32_t i32;
+    reader r(bytes, n);
+    while (!r.done()) {
+      const std::uint8_t code = r.get<std::uint8_t>();
+      switch (code) {
+      case op::nop: break;
+      case op::env: {
+	const float x1 = r.get<float>(), x2 = r.get<float>(), y1 = r.get<float>(), y2 = r.get<float>();
+	const bool just = r.get<i32>();
+	dev.env(x1, x2, y1, y2, just, axis::value(r.get<i32>()));
+	break;
+      }
+      case op::label: {
+	const std::string x = r.str(), y = r.str();
+	dev.label(x, y, r.str());
+	break;
+      }
+      case op::box: {
+	const std::string xopt = r.str();
+	const float xtick = r.get<float>();
+	const int xsub = r.get<i32>();
+	const std::string yopt = r.str();
+	const float ytick = r.get<float>();
+	dev.box(xopt, xtick, xsub, yopt, ytick, r.get<i32>());
+	break;
+      }
+      case op::viewport: case op::window: case op::window_adjust: case op::rectangle: case op::arrow: {
+	const float a = r.get<float>(), b = r.get<float>(), c = r.get<float>(), d = r.get<float>();
+	if (code == op::viewport)
+	  dev.set_viewport(a, b, c, d);
+	else if (code == op::window)
+	  dev.set_window(a, b, c, d);
+	else if (code == op::window_adjust)
+	  dev.window_adjust(a, b, c, d);
+	else if (code == op::rectangle)
+	  dev.draw_rectangle(a, b, c, d);
+	else
+	  dev.draw_arrow(a, b, c, d);
+	break;
+      }
+      case op::standard_viewport: dev.set_standard_viewport(); break;
+      case op::page: dev.page(); break;
+      case op::panel: {
+	const int x = r.get<i32>();
+	dev.panel(x, r.get<i32>());
+	break;
+      }
+      case op::subdivide: {
+	const int nx = r.get<i32>();
+	dev.subdivide(nx, r.get<i32>());
+	break;
+      }
+      case op::save: dev.select(); pgplot::save(); break;
+      case op::unsave: dev.select(); pgplot::unsave(); break;
+      case op::begin_batch: dev.select(); pgplot::begin_batch(); break;
+      case op::end_batch: dev.select(); pgplot::end_batch(); break;
+      case op::color_index: dev.set_color_index(r.get<i32>()); break;
+      case op::color_rep: {
+	const int i = r.get<i32>();
+	const float cr = r.get<float>(), cg = r.get<float>();
+	dev.set_color_rep(i, cr, cg, r.get<float>());
+	break;
+      }
+      case op::line_width: dev.set_line_width(r.get<i32>()); break;
+      case op::line_style: dev.set_line_style(linestyle::value(r.get<i32>())); break;
+      case op::char_height: dev.set_char_height(r.get<float>()); break;
+      case op::char_font: dev.set_char_font(font::value(r.get<i32>())); break;
+      case op::fill_style: dev.set_fill_style(fillstyle::value(r.get<i32>())); break;
+      case op::clipping: dev.set_clipping(r.get<i32>()); break;
+      case op::move: case op::draw: {
+	const float x = r.get<float>(), y = r.get<float>();
+	if (code == op::move)
+	  dev.move_pen(x, y);
+	else
+	  dev.draw_line(x, y);
+	break;
+      }
+      case op::circle: {
+	const float x = r.get<float>(), y = r.get<float>();
+	dev.draw_circle(x, y, r.get<float>());
+	break;
+      }
+      case op::marker: {
+	const float x = r.get<float>(), y = r.get<float>();
+	dev.draw_marker(x, y, r.get<i32>());
+	break;
+      }
+      case op::text: {
+	const float x = r.get<float>(), y = r.get<float>();
+	dev.text(x, y, r.str());
+	break;
+      }
+      case op::text_angle: {
+	const float x = r.get<float>(), y = r.get<float>(), angle = r.get<float>(), just = r.get<float>();
+	dev.text(x, y, angle, just, r.str());
+	break;
+      }
+      case op::text_side: {
+	const std::string side = r.str();
+	const float disp = r.get<float>(), coord = r.get<float>(), just = r.get<float>();
+	dev.text(side, disp, coord, just, r.str());
+	break;
+      }
+      case op::lines: case op::poly: case op::points: case op::bin: {
+	const int arg = code == op::points || code == op::bin ? r.get<i32>() : 0;
+	std::uint64_t n;
+	const float* x = r.floats(n);
+	const float* y = r.floats(n, "y");
+	if (code == op::lines)
+	  dev.draw_lines(n, x, y);
+	else if (code == op::poly)
+	  dev.draw_poly(n, x, y);
+	else if (code == op::points)
+	  dev.draw_points(n, x, y, arg);
+	else
+	  dev.hist(n, x, y, arg);
+	break;
+      }
+      case op::errbar: {
+	const err::value dir = err::value(r.get<i32>());
+	const float t = r.get<float>();
+	std::uint64_t n;
+	const float* x = r.floats(n);
+	const float* y = r.floats(n, "y");
+	dev.errbar(dir, n, x, y, r.floats(n, "error"), t);
+	break;
+      }
+      case op::errbarx: case op::errbary: {
+	const float t = r.get<float>();
+	std::uint64_t n;
+	const float* a = r.floats(n);
+	const float* b = r.floats(n, "bound");
+	const float* c = r.floats(n, "bound");
+	if (code == op::errbarx)
+	  dev.errbarx(n, a, b, c, t);
+	else
+	  dev.errbary(n, a, b, c, t);
+	break;
+      }
+      case op::hist: {
+	const float min = r.get<float>(), max = r.get<float>();
+	const int nbin = r.get<i32>(), flag = r.get<i32>();
+	std::uint64_t n;
+	const float* d = r.floats(n);
+	dev.hist(n, d, min, max, nbin, flag);
+	break;
+      }
+      default:
+	throw record_error("unknown call in recording");
+      }
+    }
+  }
+
+}
+
+#endif // PGPLOT_RECORD_HH
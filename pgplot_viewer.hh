@@ -0,0 +1,487 @@
+#ifndef PGPLOT_VIEWER_HH
+#define PGPLOT_VIEWER_HH
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pgplot.hh"
+
+namespace pgplot {
+
+  // multi-level min/max summary of a series with non-decreasing x: level
+  // L holds one block per fanout^L points, recording the lowest and
+  // highest y and where they occur, so that any x range can be drawn
+  // from the level whose block count matches the pixel width of the plot.
+  //
+  // The levels can be kept in a file next to the data and memory-mapped
+  // when the pyramid is next constructed, so that a restarted viewer
+  // need not rescan the data.  The file is native-endian: a header (see
+  // file_header), the block count of each level, then the blocks.
+  class series_pyramid {
+  public:
+    static const size_t fanout = 4;
+
+    // the data is not copied; it must outlive the pyramid
+    template<typename T1, typename T2>
+    series_pyramid(size_t n, const T1* x, const T2* y)
+      : n_(n),
+	x_([x](size_t i) { return double(x[i]); }),
+	y_([y](size_t i) { return double(y[i]); }),
+	map_(0), map_len_(0)
+    {
+      scan(x, y);
+    }
+
+    // as above, with the levels cached in cache_path (by default
+    // source_path + ".pyr"): the file is mapped if it matches the size
+    // and modification time of source_path and a sample of the data,
+    // otherwise the levels are rebuilt and the file rewritten
+    template<typename T1, typename T2>
+    series_pyramid(size_t n, const T1* x, const T2* y,
+		   const std::string& source_path, const std::string& cache_path = "")
+      : n_(n),
+	x_([x](size_t i) { return double(x[i]); }),
+	y_([y](size_t i) { return double(y[i]); }),
+	map_(0), map_len_(0)
+    {
+      const std::string path = cache_path.empty() ? source_path + ".pyr" : cache_path;
+      if (!map(path, source_path)) {
+	scan(x, y);
+	save(path, source_path);
+      }
+    }
+
+    template<typename T1, typename T2>
+    series_pyramid(const std::vector<T1>& x, const std::vector<T2>& y)
+      : series_pyramid(x.size(), detail::data_of(x), detail::data_of(y)) { }
+
+    virtual ~series_pyramid()
+    {
+      if (map_)
+	munmap(map_, map_len_);
+    }
+
+    size_t size() const throw() { return n_; }
+
+    // number of summary levels above the raw data
+    size_t levels() const throw() { return levels_.size(); }
+
+    // true when the levels come from a mapped cache file
+    bool mapped() const throw() { return map_ != 0; }
+
+    // write the levels to path, stamped with source_path's size and
+    // modification time; false if that fails
+    bool save(const std::string& path, const std::string& source_path) const
+    {
+      file_header h;
+      if (!stamp(h, source_path))
+	return false;
+      const std::string tmp = path + ".tmp";
+      std::FILE* f = std::fopen(tmp.c_str(), "wb");
+      if (!f)
+	return false;
+      bool ok = std::fwrite(&h, sizeof h, 1, f) == 1;
+      for (size_t l=0; ok && l<levels_.size(); ++l) {
+	const std::uint64_t count = levels_[l].size;
+	ok = std::fwrite(&count, sizeof count, 1, f) == 1;
+      }
+      for (size_t l=0; ok && l<levels_.size(); ++l)
+	ok = std::fwrite(levels_[l].blocks, sizeof(block), levels_[l].size, f) == levels_[l].size;
+      ok = std::fclose(f) == 0 && ok;
+      ok = ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+      if (!ok)
+	std::remove(tmp.c_str());
+      return ok;
+    }
+
+    // data limits
+    void extent(double& x1, double& x2, double& y1, double& y2) const
+    {
+      x1 = x2 = y1 = y2 = 0;
+      if (!n_)
+	return;
+      x1 = x_(0);
+      x2 = x_(n_-1);
+      const level_view& top = levels_.back();
+      y1 = top.blocks[0].lo;
+      y2 = top.blocks[0].hi;
+      for (size_t i=1; i<top.size; ++i) {
+	y1 = std::min(y1, top.blocks[i].lo);
+	y2 = std::max(y2, top.blocks[i].hi);
+      }
+    }
+
+    // the level used to draw [x1, x2] across the given number of pixels:
+    // the finest with at most two blocks per pixel, 0 meaning the raw data
+    size_t level(double x1, double x2, size_t pixels) const
+    {
+      size_t i1, i2;
+      index_range(x1, x2, i1, i2);
+      size_t level = 0;
+      for (size_t count = i2 - i1; level < levels_.size() && count > 2 * pixels; ++level)
+	count /= fanout;
+      return level;
+    }
+
+    // draw the part of the series within [x1, x2] from the level matching
+    // the pixel width; the cost depends on pixels, not on the series length
+    void draw(const device& dev, double x1, double x2, size_t pixels) const
+    {
+      size_t i1, i2;
+      index_range(x1, x2, i1, i2);
+      const size_t lev = level(x1, x2, pixels);
+      xs_.clear();
+      ys_.clear();
+      if (lev == 0)
+	for (size_t i=i1; i<i2; ++i) {
+	  xs_.push_back(x_(i));
+	  ys_.push_back(y_(i));
+	}
+      else {
+	size_t span = 1;
+	for (size_t l=0; l<lev; ++l)
+	  span *= fanout;
+	const level_view& blocks = levels_[lev-1];
+	for (size_t b=i1/span; b<(i2+span-1)/span && b<blocks.size; ++b) {
+	  const block& bl = blocks.blocks[b];
+	  const bool low_first = bl.xlo <= bl.xhi;
+	  xs_.push_back(low_first ? bl.xlo : bl.xhi);
+	  ys_.push_back(low_first ? bl.lo : bl.hi);
+	  xs_.push_back(low_first ? bl.xhi : bl.xlo);
+	  ys_.push_back(low_first ? bl.hi : bl.lo);
+	}
+      }
+      dev.draw_lines(xs_, ys_);
+    }
+
+  protected:
+    struct block { double xlo, lo, xhi, hi; };
+    struct level_view { const block* blocks; size_t size; };
+
+    struct file_header {
+      char magic[8];
+      std::uint64_t n, fanout, levels;
+      // of the source file
+      std::uint64_t size;
+      std::int64_t mtime_sec, mtime_nsec;
+      // of a sample of the data
+      std::uint64_t sample;
+    };
+
+    size_t n_;
+    std::function<double(size_t)> x_, y_;
+    // levels_[L-1] is level L, held in owned_ or in the mapping
+    std::vector<level_view> levels_;
+    std::vector< std::vector<block> > owned_;
+    void* map_;
+    size_t map_len_;
+    // vertices of the last draw, reused
+    mutable std::vector<double> xs_, ys_;
+
+    // make copy ctor and copy assignment inaccessible
+    series_pyramid(const series_pyramid&);
+    series_pyramid& operator=(const series_pyramid&);
+
+    template<typename T1, typename T2>
+    void scan(const T1* x, const T2* y)
+    {
+      if (!n_)
+	return;
+      owned_.push_back(std::vector<block>((n_ + fanout - 1) / fanout));
+      std::vector<block>& l1 = owned_.back();
+      for (size_t i=0; i<n_; ++i) {
+	block& b = l1[i / fanout];
+	const double xi = x[i], yi = y[i];
+	if (i % fanout == 0 || yi < b.lo) {
+	  b.xlo = xi;
+	  b.lo = yi;
+	}
+	if (i % fanout == 0 || yi > b.hi) {
+	  b.xhi = xi;
+	  b.hi = yi;
+	}
+      }
+      build();
+    }
+
+    // add levels above the first until one block remains
+    void build()
+    {
+      while (owned_.back().size() > 1) {
+	const std::vector<block>& lower = owned_.back();
+	std::vector<block> upper((lower.size() + fanout - 1) / fanout);
+	for (size_t i=0; i<lower.size(); ++i) {
+	  block& b = upper[i / fanout];
+	  const block& c = lower[i];
+	  if (i % fanout == 0 || c.lo < b.lo) {
+	    b.xlo = c.xlo;
+	    b.lo = c.lo;
+	  }
+	  if (i % fanout == 0 || c.hi > b.hi) {
+	    b.xhi = c.xhi;
+	    b.hi = c.hi;
+	  }
+	}
+	owned_.push_back(std::vector<block>());
+	owned_.back().swap(upper);
+      }
+      for (size_t l=0; l<owned_.size(); ++l) {
+	const level_view v = { &owned_[l][0], owned_[l].size() };
+	levels_.push_back(v);
+      }
+    }
+
+    // hash of up to 1024 evenly spaced points, so a cache file is not
+    // reused for different data of the same size
+    std::uint64_t sample() const
+    {
+      std::uint64_t h = n_;
+      const size_t step = std::max<size_t>(1, n_ / 1024);
+      for (size_t i=0; i<n_; i+=step) {
+	const double v[] = { x_(i), y_(i) };
+	for (size_t j=0; j<2; ++j) {
+	  std::uint64_t b;
+	  std::memcpy(&b, v+j, sizeof b);
+	  h = (h ^ b) * 0x100000001b3ULL;
+	}
+      }
+      return h;
+    }
+
+    bool stamp(file_header& h, const std::string& source_path) const
+    {
+      struct stat st;
+      if (stat(source_path.c_str(), &st) != 0)
+	return false;
+      std::memset(&h, 0, sizeof h);
+      std::memcpy(h.magic, "PGPYRMD1", sizeof h.magic);
+      h.n = n_;
+      h.fanout = fanout;
+      h.levels = levels_.size();
+      h.size = st.st_size;
+      h.mtime_sec = st.st_mtim.tv_sec;
+      h.mtime_nsec = st.st_mtim.tv_nsec;
+      h.sample = sample();
+      return true;
+    }
+
+    // map a cache file written by save(), if it is valid for this data
+    bool map(const std::string& path, const std::string& source_path)
+    {
+      file_header want;
+      if (!n_ || !stamp(want, source_path))
+	return false;
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+	return false;
+      struct stat st;
+      void* p = MAP_FAILED;
+      if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof want)
+	p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (p == MAP_FAILED)
+	return false;
+      map_ = p;
+      map_len_ = st.st_size;
+
+      const file_header& h = *static_cast<const file_header*>(p);
+      want.levels = h.levels;
+      bool ok = std::memcmp(&h, &want, sizeof h) == 0
+	&& map_len_ >= sizeof h + h.levels * sizeof(std::uint64_t);
+      const std::uint64_t* counts =
+	reinterpret_cast<const std::uint64_t*>(static_cast<const char*>(p) + sizeof h);
+      size_t offset = sizeof h + h.levels * sizeof(std::uint64_t);
+      for (size_t l=0; ok && l<h.levels; ++l) {
+	ok = counts[l] <= (map_len_ - offset) / sizeof(block);
+	if (ok) {
+	  const level_view v = {
+	    reinterpret_cast<const block*>(static_cast<const char*>(p) + offset), size_t(counts[l])
+	  };
+	  levels_.push_back(v);
+	  offset += counts[l] * sizeof(block);
+	}
+      }
+      if (!ok || levels_.empty() || levels_.back().size != 1) {
+	munmap(map_, map_len_);
+	map_ = 0;
+	levels_.clear();
+	return false;
+      }
+      return true;
+    }
+
+    // raw points [i1, i2) covering [x1, x2], with one neighbour either
+    // side so the line runs to the edges of the window
+    void index_range(double x1, double x2, size_t& i1, size_t& i2) const
+    {
+      if (x1 > x2)
+	std::swap(x1, x2);
+      size_t lo = 0, hi = n_;
+      while (lo < hi) {
+	const size_t mid = lo + (hi-lo) / 2;
+	if (x_(mid) < x1)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+      i1 = lo > 0 ? lo-1 : 0;
+      hi = n_;
+      while (lo < hi) {
+	const size_t mid = lo + (hi-lo) / 2;
+	if (x_(mid) <= x2)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+      i2 = std::min(n_, lo+1);
+    }
+  };
+
+  // interactive zoom and pan over one or more series: each redraw takes
+  // time proportional to the plot width in pixels, via series_pyramid.
+  //
+  // cursor keys: left button (A) twice marks a box to zoom into,
+  // right button (X) zooms out about the cursor, middle button (D)
+  // centres on the cursor, '<' and '>' pan by half a window, 'r'
+  // restores the full extent and 'q' quits
+  class viewer {
+  public:
+    explicit viewer(const device& dev) : dev_(dev) { }
+
+    // the pyramid must outlive the viewer
+    void add(const series_pyramid& series, int color_index = 1)
+    {
+      series_.push_back(std::make_pair(&series, color_index));
+    }
+
+    void set_labels(const std::string& x, const std::string& y, const std::string& top)
+    {
+      xlabel_ = x;
+      ylabel_ = y;
+      toplabel_ = top;
+    }
+
+    // data limits of all series
+    void extent(double& x1, double& x2, double& y1, double& y2) const
+    {
+      x1 = y1 = std::numeric_limits<double>::max();
+      x2 = y2 = -std::numeric_limits<double>::max();
+      for (size_t i=0; i<series_.size(); ++i) {
+	double a1, a2, b1, b2;
+	series_[i].first->extent(a1, a2, b1, b2);
+	x1 = std::min(x1, a1);
+	x2 = std::max(x2, a2);
+	y1 = std::min(y1, b1);
+	y2 = std::max(y2, b2);
+      }
+      if (x1 == x2)
+	x2 = x1 + 1;
+      if (y1 >= y2)
+	y2 = y1 + 1;
+    }
+
+    // draw the window [x1, x2] x [y1, y2], in data coordinates
+    void show(double x1, double x2, double y1, double y2) const
+    {
+      dev_.select();
+      begin_batch();
+      dev_.data_env(x1, x2, y1, y2, false, axis::axis);
+      dev_.label(xlabel_, ylabel_, toplabel_);
+      float px1, px2, py1, py2;
+      dev_.get_viewport(unit::pixel, px1, px2, py1, py2);
+      const size_t pixels = std::max(1.0f, std::abs(px2 - px1));
+      const int ci = dev_.get_color_index();
+      for (size_t i=0; i<series_.size(); ++i) {
+	dev_.set_color_index(series_[i].second);
+	series_[i].first->draw(dev_, x1, x2, pixels);
+      }
+      dev_.set_color_index(ci);
+      end_batch();
+    }
+
+    // interactive loop, returns when 'q' is pressed or the cursor fails
+    void run() const
+    {
+      double x1, x2, y1, y2;
+      extent(x1, x2, y1, y2);
+      const double fx1 = x1, fx2 = x2, fy1 = y1, fy2 = y2;
+      show(x1, x2, y1, y2);
+
+      transform xf, yf;
+      float wx = 0, wy = 0;
+      char ch;
+      for (;;) {
+	if (!dev_.band(0, false, 0, 0, wx, wy, ch))
+	  return;
+	dev_.get_data_transform(xf, yf);
+	const double x = xf.inverse(wx), y = yf.inverse(wy);
+	const double dx = x2 - x1, dy = y2 - y1;
+
+	switch (ch) {
+	case 'A': case 'a': {
+	  float ex = wx, ey = wy;
+	  if (!dev_.band(2, false, wx, wy, ex, ey, ch))
+	    return;
+	  const double x_ = xf.inverse(ex), y_ = yf.inverse(ey);
+	  if (x_ == x || y_ == y)
+	    continue;
+	  x1 = std::min(x, x_);
+	  x2 = std::max(x, x_);
+	  y1 = std::min(y, y_);
+	  y2 = std::max(y, y_);
+	  break;
+	}
+	case 'X': case 'x':
+	  x1 = x - dx;
+	  x2 = x + dx;
+	  y1 = y - dy;
+	  y2 = y + dy;
+	  break;
+	case 'D': case 'd':
+	  x1 = x - dx / 2;
+	  x2 = x + dx / 2;
+	  y1 = y - dy / 2;
+	  y2 = y + dy / 2;
+	  break;
+	case '<':
+	  x1 -= dx / 2;
+	  x2 -= dx / 2;
+	  break;
+	case '>':
+	  x1 += dx / 2;
+	  x2 += dx / 2;
+	  break;
+	case 'r': case 'R':
+	  x1 = fx1;
+	  x2 = fx2;
+	  y1 = fy1;
+	  y2 = fy2;
+	  break;
+	case 'q': case 'Q':
+	  return;
+	default:
+	  continue;
+	}
+	show(x1, x2, y1, y2);
+      }
+    }
+
+  private:
+    const device& dev_;
+    std::vector< std::pair<const series_pyramid*, int> > series_;
+    std::string xlabel_, ylabel_, toplabel_;
+  };
+
+}
+
+#endif // PGPLOT_VIEWER_HH
@@ -0,0 +1,45 @@
+// pgplotd: serve plot jobs from pgplot::plot_client on a local socket,
+// keeping devices open between them
+//
+//   pgplotd [socket]
+
+#include <iostream>
+#include <csignal>
+#include "pgplot_daemon.hh"
+
+namespace {
+  pgplot::plot_server* server = 0;
+
+  extern "C" void on_signal(int)
+  {
+    if (server)
+      server->stop();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 2) {
+    std::cerr << "usage: pgplotd [socket]" << std::endl;
+    return 2;
+  }
+
+  try {
+    pgplot::debug = false;
+    pgplot::plot_server s(argc > 1 ? argv[1] : pgplot::default_socket_path());
+    server = &s;
+
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+
+    s.run();
+  }
+  catch (const std::exception& e) {
+    std::cerr << "Exception caught, terminating: " << e.what() << std::endl;
+    return 1;
+  }
+}